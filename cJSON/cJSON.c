@@ -32,6 +32,12 @@
 #include <ctype.h>
 #include "cJSON.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define CJSON_SIMD_SCAN
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
 static const char *global_ep;
 
 const char *cJSON_GetErrorPtr(void)
@@ -129,34 +135,60 @@ void cJSON_Delete(cJSON *c)
     }
 }
 
-/* Parse the input text to generate a number, and populate the result into item. */
-static const char *parse_number(cJSON *item, const char *num)
+/* Powers of ten that are exactly representable as a double. */
+static const double exact_pow10[] =
 {
-    double n = 0;
-    double sign = 1;
-    double scale = 0;
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* 2^53: every integer up to here is exact in a double. */
+#define CJSON_MAX_EXACT_MANTISSA 9007199254740992.0
+
+/* Parse a number at num into value, without allocating. Returns a pointer past the number, or 0 if num holds no digits.
+ * The decimal mantissa is accumulated exactly while it stays below 2^53; together with a decimal exponent within +-22
+ * a single multiply or divide by an exact power of ten is then correctly rounded (Clinger's fast path). Longer
+ * mantissas and larger exponents are handed to strtod. */
+const char *cJSON_ParseDouble(const char *num, double *value)
+{
+    const char *start = num;
+    double mantissa = 0;
+    int exponent = 0;
     int subscale = 0;
     int signsubscale = 1;
+    int negative = 0;
+    int digits = 0;
+    int inexact = 0;
 
     /* Has sign? */
     if (*num == '-')
     {
-        sign = -1;
+        negative = 1;
         num++;
     }
     /* is zero */
     if (*num == '0')
     {
+        digits++;
         num++;
     }
     /* Number? */
-    if ((*num >= '1') && (*num <= '9'))
+    else if ((*num >= '1') && (*num <= '9'))
     {
         do
         {
-            n = (n * 10.0) + (*num++ - '0');
+            if (mantissa < (CJSON_MAX_EXACT_MANTISSA - 9) / 10)
+            {
+                mantissa = (mantissa * 10.0) + (*num - '0');
+            }
+            else
+            {
+                inexact = 1;
+            }
+            digits++;
+            num++;
         }
-        while ((*num >= '0') && (*num<='9'));
+        while ((*num >= '0') && (*num <= '9'));
     }
     /* Fractional part? */
     if ((*num == '.') && (num[1] >= '0') && (num[1] <= '9'))
@@ -164,10 +196,23 @@ static const char *parse_number(cJSON *item, const char *num)
         num++;
         do
         {
-            n = (n  *10.0) + (*num++ - '0');
-            scale--;
+            if (mantissa < (CJSON_MAX_EXACT_MANTISSA - 9) / 10)
+            {
+                mantissa = (mantissa * 10.0) + (*num - '0');
+                exponent--;
+            }
+            else
+            {
+                inexact = 1;
+            }
+            digits++;
+            num++;
         } while ((*num >= '0') && (*num <= '9'));
     }
+    if (!digits)
+    {
+        return 0;
+    }
     /* Exponent? */
     if ((*num == 'e') || (*num == 'E'))
     {
@@ -185,15 +230,61 @@ static const char *parse_number(cJSON *item, const char *num)
         /* Number? */
         while ((*num>='0') && (*num<='9'))
         {
-            subscale = (subscale * 10) + (*num++ - '0');
+            if (subscale < 100000)
+            {
+                subscale = (subscale * 10) + (*num - '0');
+            }
+            num++;
         }
     }
+    exponent += subscale * signsubscale;
+
+    if (mantissa == 0 && !inexact)
+    {
+        *value = 0;
+    }
+    else if (!inexact && (exponent >= -22) && (exponent <= 22))
+    {
+        *value = (exponent < 0) ? mantissa / exact_pow10[-exponent] : mantissa * exact_pow10[exponent];
+    }
+    else
+    {
+        /* correctly rounded slow path; strtod handles the sign itself */
+        *value = strtod(start, 0);
+        return num;
+    }
+    if (negative)
+    {
+        *value = -*value;
+    }
+
+    return num;
+}
+
+/* Parse the input text to generate a number, and populate the result into item. */
+static const char *parse_number(cJSON *item, const char *num)
+{
+    double n = 0;
 
-    /* number = +/- number.fraction * 10^+/- exponent */
-    n = sign * n * pow(10.0, (scale + subscale * signsubscale));
+    num = cJSON_ParseDouble(num, &n);
+    if (!num)
+    {
+        return 0;
+    }
 
     item->valuedouble = n;
-    item->valueint = (int)n;
+    if (n >= INT_MAX)
+    {
+        item->valueint = INT_MAX;
+    }
+    else if (n <= INT_MIN)
+    {
+        item->valueint = INT_MIN;
+    }
+    else
+    {
+        item->valueint = (int)n;
+    }
     item->type = cJSON_Number;
 
     return num;
@@ -442,11 +533,101 @@ static const unsigned char firstByteMark[7] =
     0xFC
 };
 
+/* Structural scan of a string literal: return a pointer to the first '\"', '\\' or '\0' at or after str.
+ * The vector variants only issue aligned loads, which never cross a page boundary, so looking
+ * at bytes past the terminator inside the last block is safe. */
+static const char *scan_string_scalar(const char *str)
+{
+    while (*str && (*str != '\"') && (*str != '\\'))
+    {
+        str++;
+    }
+
+    return str;
+}
+
+#ifdef CJSON_SIMD_SCAN
+static const char *scan_string_sse2(const char *str)
+{
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i zero = _mm_setzero_si128();
+    __m128i block;
+    int mask;
+
+    /* byte by byte up to the first 16 byte boundary */
+    for (; ((size_t)str & 15) != 0; str++)
+    {
+        if (!*str || (*str == '\"') || (*str == '\\'))
+        {
+            return str;
+        }
+    }
+    for (;; str += 16)
+    {
+        block = _mm_load_si128((const __m128i *)str);
+        mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, quote),
+            _mm_cmpeq_epi8(block, backslash)), _mm_cmpeq_epi8(block, zero)));
+        if (mask)
+        {
+            return str + __builtin_ctz(mask);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static const char *scan_string_avx2(const char *str)
+{
+    const __m256i quote = _mm256_set1_epi8('\"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i block;
+    unsigned mask;
+
+    /* byte by byte up to the first 32 byte boundary */
+    for (; ((size_t)str & 31) != 0; str++)
+    {
+        if (!*str || (*str == '\"') || (*str == '\\'))
+        {
+            return str;
+        }
+    }
+    for (;; str += 32)
+    {
+        block = _mm256_load_si256((const __m256i *)str);
+        mask = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, quote),
+            _mm256_cmpeq_epi8(block, backslash)), _mm256_cmpeq_epi8(block, zero)));
+        if (mask)
+        {
+            return str + __builtin_ctz(mask);
+        }
+    }
+}
+#endif
+
+static const char *scan_string_init(const char *str);
+
+/* Resolved on first use to the widest variant the cpu supports. */
+static const char *(*scan_string_end)(const char *str) = scan_string_init;
+
+static const char *scan_string_init(const char *str)
+{
+    const char *(*scan)(const char *) = scan_string_scalar;
+#ifdef CJSON_SIMD_SCAN
+    __builtin_cpu_init();
+    scan = __builtin_cpu_supports("avx2") ? scan_string_avx2 : scan_string_sse2;
+#endif
+    scan_string_end = scan;
+
+    return scan(str);
+}
+
 /* Parse the input text into an unescaped cstring, and populate item. */
 static const char *parse_string(cJSON *item, const char *str, const char **ep)
 {
     const char *ptr = str + 1;
     const char *end_ptr =str + 1;
+    const char *run;
     char *ptr2;
     char *out;
     int len = 0;
@@ -460,21 +641,21 @@ static const char *parse_string(cJSON *item, const char *str, const char **ep)
         return 0;
     }
 
-    while ((*end_ptr != '\"') && *end_ptr && ++len)
+    /* jump from escape to escape until the closing quote (or the terminator) */
+    end_ptr = scan_string_end(end_ptr);
+    while (*end_ptr == '\\')
     {
-        if (*end_ptr++ == '\\')
+        if (end_ptr[1] == '\0')
         {
-            if (*end_ptr == '\0')
-            {
-                /* prevent buffer overflow when last input character is a backslash */
-                return 0;
-            }
-            /* Skip escaped quotes. */
-            end_ptr++;
+            /* prevent buffer overflow when last input character is a backslash */
+            return 0;
         }
+        /* Skip escaped quotes. */
+        end_ptr = scan_string_end(end_ptr + 2);
     }
+    len = (int)(end_ptr - str - 1);
 
-    /* This is at most how long we need for the string, roughly. */
+    /* This is at most how long we need for the string. */
     out = (char*)cJSON_malloc(len + 1);
     if (!out)
     {
@@ -490,7 +671,15 @@ static const char *parse_string(cJSON *item, const char *str, const char **ep)
     {
         if (*ptr != '\\')
         {
-            *ptr2++ = *ptr++;
+            /* copy the whole run up to the next escape (or the closing quote) */
+            run = scan_string_end(ptr);
+            if (run > end_ptr)
+            {
+                run = end_ptr;
+            }
+            memcpy(ptr2, ptr, (size_t)(run - ptr));
+            ptr2 += run - ptr;
+            ptr = run;
         }
         /* escape sequence */
         else
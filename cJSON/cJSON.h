@@ -98,6 +98,8 @@ char *cJSON_GetObjectString(const cJSON *object, const char *string);
 /* Get item "string" from object. Case insensitive. */
 extern cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string);
 extern int cJSON_HasObjectItem(const cJSON *object, const char *string);
+/* Parse a JSON number at num into value without allocating. Returns a pointer past the number, or 0 if there is none. */
+extern const char *cJSON_ParseDouble(const char *num, double *value);
 /* For analysing failed parses. This returns a pointer to the parse error. You'll probably need to look a few chars back to make sense of it. Defined when cJSON_Parse() returns 0. 0 when cJSON_Parse() succeeds. */
 extern const char *cJSON_GetErrorPtr(void);
 	
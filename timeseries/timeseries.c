@@ -1,15 +1,27 @@
 #include "timeseries.h"
 #include "ts_entry.h"
 #include "ts_utils.h"
+#include "ts_options.h"
+#include "ts_pool.h"
+#include "ts_index.h"
+#include "ts_arrow.h"
+#include "ts_import.h"
+#include "ts_cold.h"
+#include "ts_doc.h"
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // TODO README:
 //   Examples
 // TODO Features:
 //   Configurable timestamp
 //   Expiration
-//   Document meta data. Data that is stored on each update. To be used for the 'exactly once' implementation, when streaming data frm kafka.
 //   interval duration. i.e '10 minute'
-//   pagination
 // TODO Redis questions:
 //   Persistency and load from disk
 // TODO Usability
@@ -25,7 +37,8 @@ static RedisModuleType *TSType;
  *   "key_fields": ["accountId", "deviceId"],
  *   "ts_fields": [ "total_amount", "page_views" ],
  *   "interval": "hour",
- *   "timeformat": "%Y:%m:%d %H:%M:%S"
+ *   "timeformat": "%Y:%m:%d %H:%M:%S",
+ *   "group": true
  *   }'
  *
  * */
@@ -34,11 +47,19 @@ char *ValidateTS(cJSON *conf, cJSON *data) {
 
     // verify interval parameter
     cJSON *interval = VALIDATE_ENUM(conf, interval, validIntervals, "second, minute, hour, day, month, year");
+    cJSON *timefmt = cJSON_GetObjectItem(conf, "timeformat");
+    if (timefmt && (timefmt->type & 0xFF) != cJSON_String)
+        return "Invalid json: timeformat is not a string";
     long timestamp = interval_timestamp(interval->valuestring, cJSON_GetObjectString(data, "timestamp"),
-        DEFAULT_TIMEFMT);
+        doc_timefmt(conf));
     if (!timestamp)
         return "Invalid json: timestamp format and data mismatch";
 
+    // verify group parameter
+    cJSON *group = cJSON_GetObjectItem(conf, "group");
+    if (group && !(group->type & (cJSON_True | cJSON_False)))
+        return "Invalid json: group is not a boolean";
+
     // verify key_fields
     cJSON *key_fields = VALIDATE_ARRAY(conf, key_fields);
     for (i=0; i < sz; i++) {
@@ -52,8 +73,28 @@ char *ValidateTS(cJSON *conf, cJSON *data) {
     	}
     }
 
+    // verify optional meta fields
+    cJSON *meta_fields = cJSON_GetObjectItem(conf, "meta_fields");
+    if (meta_fields && meta_fields->type != cJSON_Array)
+        return "Invalid json: meta_fields is not cJSON_Array";
+    for (i=0; meta_fields && i < cJSON_GetArraySize(meta_fields); i++) {
+        cJSON *m = cJSON_GetArrayItem(meta_fields, i);
+        VALIDATE_STRING_TYPE(m);
+        // Metadata is stored as "label=value", the label ends at the first '='
+        if (strchr(m->valuestring, '='))
+            return "Invalid json: meta_fields can't contain '='";
+        if (data) {
+            cJSON *metafield = cJSON_GetObjectItem(data, m->valuestring);
+            if (!metafield)
+                return "Invalid data: missing field";
+            VALIDATE_STRING_TYPE(metafield);
+        }
+    }
+
     // verify time series fields
     cJSON *ts_fields = VALIDATE_ARRAY(conf, ts_fields);
+    if (doc_group(conf) && sz > TS_MAX_COLUMNS)
+        return "Invalid json: too many ts_fields for a group";
     for (i=0; i < sz; i++) {
     	cJSON *ts_field = cJSON_GetArrayItem(ts_fields, i);
     	VALIDATE_STRING_TYPE(ts_field);
@@ -99,27 +140,36 @@ int TSCreateDoc(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     return REDISMODULE_OK;
 }
 
-/* Add new item to array
- * Currently increase in 1 item at a time.
- * TODO increase array size in chunks
- * TODO Handle reached entries limit
- * */
-void TSAddItem(struct TSObject *o, double value, time_t timestamp) {
-    size_t idx = idx_timestamp(o->init_timestamp, timestamp, o->interval);
+#define TS_DUPLICATE_OFFSET "ERR duplicate offset: already inserted from this source partition"
 
-    if (idx >= o->len) {
-        size_t newSize = idx + 1;
-        o->entry = RedisModule_Realloc(o->entry, sizeof(TSEntry) * newSize);
-        bzero(&o->entry[o->len], sizeof(TSEntry) * (newSize - o->len));
-        o->len = newSize;
-    }
+/* Parse a trailing OFFSET <source> <partition> <offset>, and remove it from argc.
+ * Returns REDISMODULE_ERR if the token is malformed. */
+int ts_offset_parse(RedisModuleString **argv, int *argc, int start, TSOffsetToken *token) {
+    memset(token, 0, sizeof(*token));
+    int i = RMUtil_ArgExists("OFFSET", argv, *argc, start);
+    if (!i)
+        return REDISMODULE_OK;
 
-    TSEntry *e = &o->entry[idx];
-    e->avg = (e->avg * e->count + value) / (e->count + 1);
-    e->count++;
+    if (i != *argc - 4 || RedisModule_StringToLongLong(argv[i + 2], &token->partition) != REDISMODULE_OK ||
+        RedisModule_StringToLongLong(argv[i + 3], &token->offset) != REDISMODULE_OK ||
+        token->partition < 0 || token->partition > UINT32_MAX || token->offset < 0)
+        return REDISMODULE_ERR;
+    token->source = RedisModule_StringPtrLen(argv[i + 1], NULL);
+    *argc = i;
+    return REDISMODULE_OK;
 }
 
-int ts_insert(RedisModuleCtx *ctx, RedisModuleString *name, double value, char *timestamp_str) {
+/* Can a value be added to a single value series at an already resolved timestamp?
+ * Returns an error message, or NULL with the timestamp and outlier set as in ts_timestamp_check. */
+const char *ts_insert_check(struct TSObject *tso, time_t *timestamp, TSOutlier *outlier) {
+    *outlier = ts_outlier_none;
+    if (tso->columns)
+        return "ERR invalid key: series has multiple columns";
+    return ts_timestamp_check(tso, timestamp, 1, outlier);
+}
+
+int ts_insert(RedisModuleCtx *ctx, RedisModuleString *name, double value, char *timestamp_str,
+              TSOffsetToken *token) {
     RedisModuleKey *key = RedisModule_OpenKey(ctx, name, REDISMODULE_READ|REDISMODULE_WRITE);
 
     if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY)
@@ -132,10 +182,21 @@ int ts_insert(RedisModuleCtx *ctx, RedisModuleString *name, double value, char *
     if (!timestamp)
         return RedisModule_ReplyWithError(ctx,"ERR invalid value: Time Stamp is not valid");
 
-    if (timestamp < tso->init_timestamp)
-        return RedisModule_ReplyWithError(ctx,"ERR invalid value: Time Stamp is too early");
-    /* Add new item */
-    TSAddItem(tso, value, timestamp);
+    TSOutlier outlier;
+    const char *err = ts_insert_check(tso, &timestamp, &outlier);
+    if (err) {
+        ts_outlier_count(tso, outlier);
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+    if (token->source) {
+        if (!ts_offset_new(tso, token->source, token->partition, token->offset))
+            return RedisModule_ReplyWithError(ctx, TS_DUPLICATE_OFFSET);
+        ts_offset_set(tso, token->source, token->partition, token->offset);
+    }
+    // A dropped value still consumes its offset
+    ts_outlier_count(tso, outlier);
+    if (timestamp)
+        TSAddItem(tso, value, timestamp);
     RedisModule_ReplyWithSimpleString(ctx, "OK");
 
     /* Didn't understand it yet. Just copied from example */
@@ -144,32 +205,111 @@ int ts_insert(RedisModuleCtx *ctx, RedisModuleString *name, double value, char *
     return REDISMODULE_OK;
 }
 
+/* Add a value to every column of a series, argv holds the values optionally followed by the timestamp */
+int ts_insert_row(RedisModuleCtx *ctx, RedisModuleString *name, RedisModuleString **argv, int argc,
+                  TSOffsetToken *token) {
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, name, REDISMODULE_READ|REDISMODULE_WRITE);
+
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY)
+        return RedisModule_ReplyWithError(ctx, "key doesn't exist");
+    if (RedisModule_ModuleTypeGetType(key) != TSType)
+        return RedisModule_ReplyWithError(ctx, "key is not time series");
+    struct TSObject *tso = RedisModule_ModuleTypeGetValue(key);
+
+    if ((size_t)argc != tso->ncols && (size_t)argc != tso->ncols + 1)
+        return RedisModule_ReplyWithError(ctx, "ERR invalid value: expecting a value per column");
+
+    double values[tso->ncols];
+    for (size_t i = 0; i < tso->ncols; i++)
+        if (str2double(argv[i], &values[i]) != REDISMODULE_OK)
+            return RedisModule_ReplyWithError(ctx,"ERR invalid value: must be a double");
+
+    const char *timestamp_str = (size_t)argc > tso->ncols ? RedisModule_StringPtrLen(argv[tso->ncols], NULL) : NULL;
+    time_t timestamp = interval2timestamp(tso->interval, timestamp_str, tso->timefmt);
+    if (!timestamp)
+        return RedisModule_ReplyWithError(ctx,"ERR invalid value: Time Stamp is not valid");
+    TSOutlier outlier;
+    const char *err = ts_timestamp_check(tso, &timestamp, 1, &outlier);
+    if (err) {
+        ts_outlier_count(tso, outlier);
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+
+    if (token->source) {
+        if (!ts_offset_new(tso, token->source, token->partition, token->offset))
+            return RedisModule_ReplyWithError(ctx, TS_DUPLICATE_OFFSET);
+        ts_offset_set(tso, token->source, token->partition, token->offset);
+    }
+    ts_outlier_count(tso, outlier);
+    if (timestamp)
+        TSAddRow(tso, values, timestamp);
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
+
 int TSInsert(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RedisModule_AutoMemory(ctx);
+    TSOffsetToken token;
+
+    if (ts_offset_parse(argv, &argc, 3, &token) != REDISMODULE_OK)
+        return RedisModule_ReplyWithError(ctx, "ERR invalid offset: must be OFFSET <source> <partition> <offset>");
+
+    if (argc > 3 && !strcasecmp(RedisModule_StringPtrLen(argv[2], NULL), "VALUES"))
+        return ts_insert_row(ctx, argv[1], &argv[3], argc - 3, &token);
 
     if (argc < 3 || argc > 4)
         return RedisModule_WrongArity(ctx);
 
     double value;
-    if ((RedisModule_StringToDouble(argv[2],&value) != REDISMODULE_OK))
+    if ((str2double(argv[2],&value) != REDISMODULE_OK))
         return RedisModule_ReplyWithError(ctx,"ERR invalid value: must be a double");
 
-    return ts_insert(ctx, argv[1], value, argc == 4 ? (char*)RedisModule_StringPtrLen(argv[3], NULL) : NULL);
+    return ts_insert(ctx, argv[1], value, argc == 4 ? (char*)RedisModule_StringPtrLen(argv[3], NULL) : NULL, &token);
+}
+
+/* Set a new, empty series on an empty key opened for writing */
+struct TSObject *ts_create_object(RedisModuleKey *key, Interval interval, const TSTimeFmt *timefmt,
+                                  time_t init_timestamp) {
+    struct TSObject *tso = createTSObject();
+    tso->interval = interval;
+    tso->timefmt = timefmt;
+    tso->init_timestamp = init_timestamp;
+    RedisModule_ModuleTypeSetValue(key, TSType, tso);
+    return tso;
 }
 
-int ts_create(RedisModuleCtx *ctx, RedisModuleString *name, const char *interval, const char *timefmt, const char *timestamp) {
+/* Create a series, with a value column per name in columns when ncols isn't 0 */
+int ts_create(RedisModuleCtx *ctx, RedisModuleString *name, const char *interval, const char *timefmt,
+              const char *timestamp, RedisModuleString **columns, int ncols) {
+    const char *names[TS_MAX_COLUMNS];
+
+    if (ncols > TS_MAX_COLUMNS)
+        return RedisModule_ReplyWithError(ctx,"ERR invalid columns: too many columns");
+    for (int i = 0; i < ncols; i++) {
+        names[i] = RedisModule_StringPtrLen(columns[i], NULL);
+        for (int j = 0; j < i; j++)
+            if (!strcmp(names[i], names[j]))
+                return RedisModule_ReplyWithError(ctx,"ERR invalid columns: duplicate column name");
+    }
+
     RedisModuleKey *key = RedisModule_OpenKey(ctx, name, REDISMODULE_READ|REDISMODULE_WRITE);
 
     if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY)
         return RedisModule_ReplyWithError(ctx,"key already exist");
 
-    struct TSObject *tso = createTSObject();
-    RedisModule_ModuleTypeSetValue(key, TSType, tso);
-    tso->interval = str2interval(interval);
-    if (tso->interval == none)
+    Interval i = str2interval(interval);
+    if (i == none)
         return RedisModule_ReplyWithError(ctx,"Invalid interval. Must be one of: second, minute, hour, day, month, year");
-    tso->timefmt = timefmt;
-    tso->init_timestamp = interval_timestamp(interval, timestamp, tso->timefmt);
+
+    const TSTimeFmt *fmt = ts_timefmt_new(timefmt);
+    time_t init_timestamp = interval2timestamp(i, timestamp, fmt);
+    if (!init_timestamp) {
+        ts_timefmt_free(fmt);
+        return RedisModule_ReplyWithError(ctx,"ERR invalid value: Time Stamp is not valid");
+    }
+
+    struct TSObject *tso = ts_create_object(key, i, fmt, init_timestamp);
+    if (ncols)
+        ts_set_columns(tso, ncols, names);
 
     return RedisModule_ReplyWithSimpleString(ctx, "OK");
 }
@@ -177,30 +317,349 @@ int ts_create(RedisModuleCtx *ctx, RedisModuleString *name, const char *interval
 int TSCreate(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RedisModule_AutoMemory(ctx);
 
-    if (argc < 3 || argc > 4)
+    // Optional trailing COLUMNS name [name ...], after an optional TIMEFMT format
+    int cols = RMUtil_ArgExists("COLUMNS", argv, argc, 3);
+    int nargs = cols ? cols : argc;
+    int tf = RMUtil_ArgExists("TIMEFMT", argv, nargs, 3);
+    if (tf && tf + 2 != nargs)
+        return RedisModule_WrongArity(ctx);
+    if (tf)
+        nargs = tf;
+    if (nargs < 3 || nargs > 4 || cols == argc - 1)
         return RedisModule_WrongArity(ctx);
 
     return ts_create(ctx, argv[1], RedisModule_StringPtrLen(argv[2], NULL),
-        DEFAULT_TIMEFMT, argc == 4 ? RedisModule_StringPtrLen(argv[3], NULL) : NULL);
+        tf ? RedisModule_StringPtrLen(argv[tf + 1], NULL) : DEFAULT_TIMEFMT,
+        nargs == 4 ? RedisModule_StringPtrLen(argv[3], NULL) : NULL,
+        cols ? &argv[cols + 1] : NULL, cols ? argc - cols - 1 : 0);
 }
 
-int TSInsertDoc(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+void ts_doc_free(TSDoc *doc) {
+    if (doc->keys)
+        RedisModule_Free(doc->keys[0]);
+    if (doc->columns)
+        RedisModule_Free((char *)doc->columns[0]);
+    if (doc->labels)
+        RedisModule_Free(doc->labels[0]);
+    RedisModule_Free(doc->labels);
+    if (doc->meta)
+        RedisModule_Free(doc->meta[0]);
+    RedisModule_Free(doc->meta);
+    RedisModule_Free(doc->name);
+    RedisModule_Free((char *)doc->offset.source);
+    RedisModule_Free(doc->columns);
+    RedisModule_Free(doc->keys);
+    RedisModule_Free(doc->key_lens);
+    RedisModule_Free(doc->values);
+    RedisModule_Free(doc->timestamp_str);
+    RedisModule_Free(doc->timefmt_str);
+    memset(doc, 0, sizeof(*doc));
+}
+
+/* Parse and validate a document against the configuration of 'name'.
+ * Returns an error message, or NULL if doc is ready to be applied. */
+const char *ts_doc_prepare(TSDoc *doc, const char *name, const char *conf_str, const char *data_str,
+                           TSOffsetToken *offset) {
     cJSON *conf = NULL;
     cJSON *data = NULL;
-    RedisModuleCallReply *confRep = NULL;
     const char *jsonErr;
 
-    void cleanup(void) {
+    const char *exit_status(const char *err) {
         cJSON_Delete(data);
         cJSON_Delete(conf);
-        RedisModule_FreeCallReply(confRep);
+        return err;
     }
 
-    int exit_status(int status) {
-        cleanup();
-        return status;
+    memset(doc, 0, sizeof(*doc));
+
+    // Time series entry conf previously stored for 'name'
+    if (!(conf=cJSON_Parse(conf_str)))
+        return exit_status("Something is wrong. Failed to parse ts conf");
+
+    // Time series entry data
+    if (!(data=cJSON_Parse(data_str)))
+        return exit_status("Invalid json");
+
+    if ((jsonErr = ValidateTS(conf, data)))
+        return exit_status(jsonErr);
+
+    // Create timestamp. Use a single timestamp for all entries, not to accidently use different entries in case
+    // during the calculation the time has changed)
+    const char *timestamp_str = cJSON_GetObjectString(data, "timestamp");
+    doc->interval = str2interval(cJSON_GetObjectItem(conf, "interval")->valuestring);
+    doc->timefmt_str = RedisModule_Strdup(doc_timefmt(conf));
+    ts_timefmt_compile(&doc->timefmt, doc->timefmt_str);
+    doc->timestamp = interval2timestamp(doc->interval, timestamp_str, &doc->timefmt);
+    if (timestamp_str)
+        doc->timestamp_str = RedisModule_Strdup(timestamp_str);
+
+    char key_buf[TS_MAX_KEY_LEN];
+    size_t prefix_len = doc_key_prefix(key_buf, sizeof(key_buf), name, conf, data);
+    if (!prefix_len)
+        return exit_status("ERR invalid data: key too long");
+    doc->name = RedisModule_Strdup(name);
+    doc->prefix_len = prefix_len;
+    if (offset->source) {
+        doc->offset = *offset;
+        doc->offset.source = RedisModule_Strdup(offset->source);
+    }
+
+    doc->labels = doc_labels(conf, "key_fields", data, &doc->nlabels);
+    doc->meta = doc_labels(conf, "meta_fields", data, &doc->nmeta);
+
+    cJSON *ts_fields = cJSON_GetObjectItem(conf, "ts_fields");
+    doc->n = cJSON_GetArraySize(ts_fields);
+
+    // A group stores every ts field as a column of a single key named after the prefix
+    if (doc_group(conf)) {
+        size_t arena_len = 0;
+        for (int i=0; i < doc->n; i++)
+            arena_len += strlen(cJSON_GetArrayItem(ts_fields, i)->valuestring) + 1;
+
+        doc->nkeys = 1;
+        doc->keys = RedisModule_Alloc(sizeof(char *));
+        doc->keys[0] = RedisModule_Strdup(key_buf);
+        doc->key_lens = RedisModule_Alloc(sizeof(size_t));
+        doc->key_lens[0] = prefix_len;
+        doc->columns = RedisModule_Alloc(doc->n * sizeof(char *));
+        doc->values = RedisModule_Alloc(doc->n * sizeof(double));
+        char *column = RedisModule_Alloc(arena_len);
+        for (int i=0; i < doc->n; i++) {
+            cJSON *ts_field = cJSON_GetArrayItem(ts_fields, i);
+            size_t len = strlen(ts_field->valuestring) + 1;
+            doc->columns[i] = memcpy(column, ts_field->valuestring, len);
+            column += len;
+            doc->values[i] = agg_value(data, ts_field);
+        }
+        return exit_status(NULL);
+    }
+
+    doc->nkeys = doc->n;
+    size_t arena_len = 0;
+    for (int i=0; i < doc->n; i++)
+        arena_len += prefix_len + strlen(cJSON_GetArrayItem(ts_fields, i)->valuestring) + 2;
+
+    doc->keys = RedisModule_Alloc(doc->n * sizeof(char *));
+    doc->keys[0] = RedisModule_Alloc(arena_len);
+    doc->key_lens = RedisModule_Alloc(doc->n * sizeof(size_t));
+    doc->values = RedisModule_Alloc(doc->n * sizeof(double));
+    for (int i=0; i < doc->n; i++) {
+        cJSON *ts_field = cJSON_GetArrayItem(ts_fields, i);
+        if (!(doc->key_lens[i] = doc_agg_key(key_buf, sizeof(key_buf), prefix_len, ts_field)))
+            return exit_status("ERR invalid data: key too long");
+        if (i)
+            doc->keys[i] = doc->keys[i - 1] + doc->key_lens[i - 1] + 1;
+        memcpy(doc->keys[i], key_buf, doc->key_lens[i] + 1);
+        doc->values[i] = agg_value(data, ts_field);
+    }
+
+    return exit_status(NULL);
+}
+
+/* Does an existing series have the layout the document writes? */
+static int ts_doc_columns_match(struct TSObject *tso, TSDoc *doc) {
+    if (!doc->columns || !tso->columns)
+        return !doc->columns && !tso->columns;
+    if (tso->ncols != (size_t)doc->n)
+        return 0;
+    for (int i=0; i < doc->n; i++)
+        if (tso->columns[i] != ts_intern_find(doc->columns[i], strlen(doc->columns[i])))
+            return 0;
+    return 1;
+}
+
+/* Document offsets are kept in the doc configuration hash, a field per source partition */
+static RedisModuleString *ts_doc_offset_field(RedisModuleCtx *ctx, TSDoc *doc) {
+    return RedisModule_CreateStringPrintf(ctx, "offset:%s:%lld", doc->offset.source, doc->offset.partition);
+}
+
+/* Is the document offset past the last one inserted from its source partition? */
+static int ts_doc_offset_new(RedisModuleCtx *ctx, TSDoc *doc) {
+    RedisModuleString *field = ts_doc_offset_field(ctx, doc);
+    RedisModuleCallReply *rep = RedisModule_Call(ctx, "HGET", "cs", doc->name, field);
+    long long last;
+    int new = 1;
+
+    if (rep && RedisModule_CallReplyType(rep) == REDISMODULE_REPLY_STRING) {
+        RedisModuleString *str = RedisModule_CreateStringFromCallReply(rep);
+        new = RedisModule_StringToLongLong(str, &last) != REDISMODULE_OK || doc->offset.offset > last;
+        RedisModule_FreeString(ctx, str);
     }
+    if (rep)
+        RedisModule_FreeCallReply(rep);
+    RedisModule_FreeString(ctx, field);
+    return new;
+}
+
+static void ts_doc_offset_set(RedisModuleCtx *ctx, TSDoc *doc) {
+    RedisModuleString *field = ts_doc_offset_field(ctx, doc);
+    RedisModuleCallReply *rep = RedisModule_Call(ctx, "HSET", "csl", doc->name, field, doc->offset.offset);
+    if (rep)
+        RedisModule_FreeCallReply(rep);
+    RedisModule_FreeString(ctx, field);
+}
+
+/* The start of a series a document creates: the document time, held to MAX_FUTURE as in ts_timestamp_check.
+ * A dropped document still creates the series, at the latest time allowed, to count it.
+ * Returns an error message, or NULL with the timestamp and outlier set as in ts_timestamp_check. */
+static const char *ts_doc_start(const TSDoc *doc, time_t *timestamp, TSOutlier *outlier, time_t *start) {
+    struct TSObject probe = { .interval = doc->interval };
+    const char *err = ts_timestamp_check(&probe, timestamp, 0, outlier);
+
+    *start = *timestamp ? *timestamp : interval_epoch(doc->interval, time(NULL) + ts_options.max_future);
+    return err;
+}
 
+/* Add a prepared document to its aggregation keys, creating the missing ones.
+ * Every key is opened once, and all of them are validated before any is updated.
+ * Returns an error message, or NULL if the document was added. */
+const char *ts_doc_apply(RedisModuleCtx *ctx, TSDoc *doc) {
+    RedisModuleString *names[doc->nkeys];
+    RedisModuleKey *keys[doc->nkeys];
+    time_t timestamps[doc->nkeys];
+    TSOutlier outliers[doc->nkeys];
+    time_t start = doc->timestamp;
+    const char *err = NULL;
+    int opened, created = 0;
+
+    // A replayed document is dropped before any key is opened
+    if (doc->offset.source && !ts_doc_offset_new(ctx, doc))
+        return TS_DUPLICATE_OFFSET;
+
+    for (opened=0; !err && opened < doc->nkeys; opened++) {
+        int i = opened;
+        names[i] = RedisModule_CreateString(ctx, doc->keys[i], doc->key_lens[i]);
+        keys[i] = RedisModule_OpenKey(ctx, names[i], REDISMODULE_READ | REDISMODULE_WRITE);
+        timestamps[i] = doc->timestamp;
+        outliers[i] = ts_outlier_none;
+        if (RedisModule_KeyType(keys[i]) == REDISMODULE_KEYTYPE_EMPTY) {
+            created = 1;
+            err = ts_doc_start(doc, &timestamps[i], &outliers[i], &start);
+            continue;
+        }
+        if (RedisModule_ModuleTypeGetType(keys[i]) != TSType) {
+            err = "key is not time series";
+            continue;
+        }
+
+        // A series created with another interval buckets the document time on its own boundaries
+        struct TSObject *tso = RedisModule_ModuleTypeGetValue(keys[i]);
+        if (!ts_doc_columns_match(tso, doc)) {
+            err = "ERR invalid key: series columns don't match the document";
+            continue;
+        }
+        if (tso->interval != doc->interval)
+            timestamps[i] = interval2timestamp(tso->interval, doc->timestamp_str, tso->timefmt);
+        // Outliers are counted once the document is added, or on the key that rejects it
+        if ((err = ts_timestamp_check(tso, &timestamps[i], 1, &outliers[i])))
+            ts_outlier_count(tso, outliers[i]);
+    }
+
+    if (!err && doc->columns) {
+        struct TSObject *tso;
+        if (RedisModule_KeyType(keys[0]) == REDISMODULE_KEYTYPE_EMPTY) {
+            tso = ts_create_object(keys[0], doc->interval, ts_timefmt_new(doc->timefmt_str), start);
+            ts_set_columns(tso, doc->n, doc->columns);
+            ts_set_meta(tso, doc->meta, doc->nmeta);
+        } else {
+            tso = RedisModule_ModuleTypeGetValue(keys[0]);
+        }
+        ts_outlier_count(tso, outliers[0]);
+        if (timestamps[0])
+            TSAddRow(tso, doc->values, timestamps[0]);
+    }
+
+    for (int i=0; !err && !doc->columns && i < doc->n; i++) {
+        struct TSObject *tso;
+        if (RedisModule_KeyType(keys[i]) == REDISMODULE_KEYTYPE_EMPTY) {
+            tso = ts_create_object(keys[i], doc->interval, ts_timefmt_new(doc->timefmt_str), start);
+            ts_set_meta(tso, doc->meta, doc->nmeta);
+        } else {
+            tso = RedisModule_ModuleTypeGetValue(keys[i]);
+        }
+        // Every key was checked above, new ones start at the checked document time
+        ts_outlier_count(tso, outliers[i]);
+        if (timestamps[i])
+            TSAddItem(tso, doc->values[i], timestamps[i]);
+    }
+
+    for (int i=0; i < opened; i++) {
+        RedisModule_CloseKey(keys[i]);
+        RedisModule_FreeString(ctx, names[i]);
+    }
+
+    // A new entity is indexed by its key fields
+    if (!err && created)
+        ts_index_add(ctx, doc->name, doc->keys[0], doc->prefix_len, doc->labels, doc->nlabels);
+    if (!err && doc->offset.source)
+        ts_doc_offset_set(ctx, doc);
+    return err;
+}
+
+/* TS.INSERTDOC running on a worker thread while its client is blocked */
+typedef struct TSDocJob {
+    RedisModuleBlockedClient *bc;
+    char *name;
+    char *conf;
+    char *data;
+    TSOffsetToken offset;   // Its source is owned by the job
+    const char *err;
+    TSDoc doc;
+} TSDocJob;
+
+/* Parse and validate on the worker. Only applying the buckets takes the redis lock. */
+void ts_doc_job(void *arg) {
+    TSDocJob *job = arg;
+
+    if (!(job->err = ts_doc_prepare(&job->doc, job->name, job->conf, job->data, &job->offset))) {
+        RedisModuleCtx *ctx = RedisModule_GetThreadSafeContext(job->bc);
+        RedisModule_ThreadSafeContextLock(ctx);
+        job->err = ts_doc_apply(ctx, &job->doc);
+        RedisModule_ThreadSafeContextUnlock(ctx);
+        RedisModule_FreeThreadSafeContext(ctx);
+    }
+    RedisModule_UnblockClient(job->bc, job);
+}
+
+int TSInsertDocReply(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    TSDocJob *job = RedisModule_GetBlockedClientPrivateData(ctx);
+    if (job->err)
+        return RedisModule_ReplyWithError(ctx, job->err);
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
+
+void TSInsertDocFree(void *privdata) {
+    TSDocJob *job = privdata;
+    ts_doc_free(&job->doc);
+    RedisModule_Free(job->name);
+    RedisModule_Free(job->conf);
+    RedisModule_Free(job->data);
+    RedisModule_Free((char *)job->offset.source);
+    RedisModule_Free(job);
+}
+
+int ts_async_enabled = 1;
+
+/* Can this command be handed to a worker? Clients inside lua or MULTI can't be blocked */
+int ts_can_block(RedisModuleCtx *ctx) {
+    if (!ts_async_enabled || !ts_pool_size() || !RedisModule_BlockClient)
+        return 0;
+    return !RedisModule_GetContextFlags ||
+        !(RedisModule_GetContextFlags(ctx) & (REDISMODULE_CTX_FLAGS_LUA | REDISMODULE_CTX_FLAGS_MULTI));
+}
+
+int TSInsertDoc(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModuleCallReply *confRep = NULL;
+    const char *err;
+    TSDoc doc;
+
+    void cleanup(void) {
+        RedisModule_FreeCallReply(confRep);
+    }
+
+    TSOffsetToken offset;
+    if (ts_offset_parse(argv, &argc, 3, &offset) != REDISMODULE_OK)
+        return RedisModule_ReplyWithError(ctx, "ERR invalid offset: must be OFFSET <source> <partition> <offset>");
     if (argc != 3) {
         return RedisModule_WrongArity(ctx);
     }
@@ -212,55 +671,236 @@ int TSInsertDoc(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     confRep = RedisModule_Call(ctx, "HGET", "cc", name, name);
     RMUTIL_ASSERT_NONULL(confRep, name, cleanup);
 
-    // Time series entry conf previously stored for 'name'
-    if (!(conf=cJSON_Parse(RedisModule_CallReplyStringPtr(confRep, NULL))))
-        return exit_status(RedisModule_ReplyWithError(ctx, "Something is wrong. Failed to parse ts conf"));
+    size_t conf_len, data_len;
+    const char *conf = RedisModule_CallReplyStringPtr(confRep, &conf_len);
+    const char *data = RedisModule_StringPtrLen(argv[2], &data_len);
+
+    if (ts_can_block(ctx)) {
+        TSDocJob *job = RedisModule_Calloc(1, sizeof(*job));
+        job->name = RedisModule_Strdup(name);
+        job->conf = RedisModule_Alloc(conf_len + 1);
+        memcpy(job->conf, conf, conf_len);
+        job->conf[conf_len] = '\0';
+        job->data = RedisModule_Alloc(data_len + 1);
+        memcpy(job->data, data, data_len + 1);
+        job->offset = offset;
+        if (offset.source)
+            job->offset.source = RedisModule_Strdup(offset.source);
+        cleanup();
 
-    // Time series entry data
-    if (!(data=cJSON_Parse(RedisModule_StringPtrLen(argv[2], NULL))))
-        return exit_status(RedisModule_ReplyWithError(ctx, "Invalid json"));
+        job->bc = RedisModule_BlockClient(ctx, TSInsertDocReply, NULL, TSInsertDocFree, 0);
+        ts_pool_submit(ts_doc_job, job);
+        return REDISMODULE_OK;
+    }
 
-    if ((jsonErr = ValidateTS(conf, data)))
-        return exit_status(RedisModule_ReplyWithError(ctx, jsonErr));
+    if (!(err = ts_doc_prepare(&doc, name, conf, data, &offset)))
+        err = ts_doc_apply(ctx, &doc);
+    ts_doc_free(&doc);
+    cleanup();
 
-    // Create timestamp. Use a single timestamp for all entries, not to accidently use different entries in case
-    // during the calculation the time has changed)
-    long timestamp = interval_timestamp(cJSON_GetObjectItem(conf, "interval")->valuestring,
-        cJSON_GetObjectString(data, "timestamp"), DEFAULT_TIMEFMT);
+    if (err)
+        return RedisModule_ReplyWithError(ctx, err);
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
 
-    char *key_prefix = doc_key_prefix(name, conf, data);
+/* The parsed TS.CREATEDOC configuration of 'name', or NULL with *err set */
+static cJSON *ts_doc_conf(RedisModuleCtx *ctx, const char *name, const char **err) {
+    cJSON *conf = NULL;
+    RedisModuleCallReply *confRep = RedisModule_Call(ctx, "HGET", "cc", name, name);
+
+    if (!confRep || RedisModule_CallReplyType(confRep) != REDISMODULE_REPLY_STRING)
+        *err = "ERR invalid doc: TS.CREATEDOC wasn't called for this name";
+    else if (!(conf = cJSON_Parse(RedisModule_CallReplyStringPtr(confRep, NULL))))
+        *err = "Something is wrong. Failed to parse ts conf";
+    if (confRep)
+        RedisModule_FreeCallReply(confRep);
+    return conf;
+}
+
+/* Flag the filters on meta fields of the doc, they are matched against each series by interned id */
+static void ts_doc_meta_filters(cJSON *conf, TSFilter *filters, int n) {
+    cJSON *meta_fields = cJSON_GetObjectItem(conf, "meta_fields");
+
+    for (int i = 0; meta_fields && i < n; i++) {
+        for (int j = 0; !filters[i].meta && j < cJSON_GetArraySize(meta_fields); j++) {
+            const char *field = cJSON_GetArrayItem(meta_fields, j)->valuestring;
+            filters[i].meta = !strncmp(field, filters[i].label, filters[i].label_len) &&
+                !field[filters[i].label_len];
+        }
+        if (filters[i].meta) {
+            filters[i].label_id = ts_intern_find(filters[i].label, filters[i].label_len);
+            filters[i].value_id = ts_intern_find(filters[i].value, strlen(filters[i].value));
+        }
+    }
+}
+
+/* Does the metadata of a series match every meta filter? */
+static int ts_meta_match(struct TSObject *tso, TSFilter *filters, int n) {
+    for (int i = 0; i < n; i++) {
+        if (!filters[i].meta)
+            continue;
+        TSAtom value = ts_meta(tso, filters[i].label_id);
+        if ((value != TS_ATOM_NONE && value == filters[i].value_id) == filters[i].negate)
+            return 0;
+    }
+    return 1;
+}
 
+/* Series keys of an entity that still exist and match the meta filters. An entity with none
+ * left is dropped from the index. */
+static size_t ts_entity_series(RedisModuleCtx *ctx, const char *name, RedisModuleString *entity, cJSON *conf,
+                               TSFilter *filters, int nfilters, RedisModuleString **series) {
     cJSON *ts_fields = cJSON_GetObjectItem(conf, "ts_fields");
-    for (int i=0; i < cJSON_GetArraySize(ts_fields); i++) {
-        char *agg_key = doc_agg_key(key_prefix, cJSON_GetArrayItem(ts_fields, i));
-        double value = agg_value(data, cJSON_GetArrayItem(ts_fields, i));
-
-        char timestamp_key[100];
-        sprintf(timestamp_key, "%li", timestamp);
-
-        RedisModuleString *strkey = RedisModule_CreateStringPrintf(ctx, "%s", agg_key);
-        RedisModuleKey *key = RedisModule_OpenKey(ctx, strkey, REDISMODULE_READ | REDISMODULE_WRITE);
-        if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
-            ts_create(ctx, strkey, cJSON_GetObjectItem(conf, "interval")->valuestring, DEFAULT_TIMEFMT,
-                    cJSON_GetObjectString(data, "timestamp"));
-        } else if (RedisModule_ModuleTypeGetType(key) != TSType) {
-            return RedisModule_ReplyWithError(ctx, "key is not time series");
+    int group = doc_group(conf);
+    int nfields = group ? 1 : cJSON_GetArraySize(ts_fields);
+    size_t n = 0;
+    int exists = 0;
+
+    for (int i = 0; i < nfields; i++) {
+        RedisModuleString *key = group ? entity : RedisModule_CreateStringPrintf(ctx, "%s:%s",
+            RedisModule_StringPtrLen(entity, NULL), cJSON_GetArrayItem(ts_fields, i)->valuestring);
+        RedisModuleKey *k = RedisModule_OpenKey(ctx, key, REDISMODULE_READ);
+        if (RedisModule_KeyType(k) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(k) == TSType) {
+            exists = 1;
+            if (ts_meta_match(RedisModule_ModuleTypeGetValue(k), filters, nfilters))
+                series[n++] = key;
         }
-        RedisModule_CloseKey(key);
+        RedisModule_CloseKey(k);
+    }
+
+    if (!exists) {
+        cJSON *key_fields = cJSON_GetObjectItem(conf, "key_fields");
+        int nkeys = cJSON_GetArraySize(key_fields);
+        const char *fields[nkeys ? nkeys : 1];
+        for (int i = 0; i < nkeys; i++)
+            fields[i] = cJSON_GetArrayItem(key_fields, i)->valuestring;
+        ts_index_remove(ctx, name, entity, fields, nkeys);
+    }
+    return n;
+}
+
+/**
+ * TS.QUERYINDEX <name> [label=value | label!=value ...]
+ * Series keys of doc 'name' whose key fields match every filter.
+ * */
+int TSQueryIndex(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    cJSON *conf = NULL;
+    const char *err;
+
+    int exit_status(int status) {
+        cJSON_Delete(conf);
+        return status;
+    }
+
+    if (argc < 2)
+        return RedisModule_WrongArity(ctx);
+    RedisModule_AutoMemory(ctx);
 
-        //TODO check errors
-        ts_insert(ctx, strkey, value, cJSON_GetObjectString(data, "timestamp"));
+    const char *name = RedisModule_StringPtrLen(argv[1], NULL);
+    if (!(conf = ts_doc_conf(ctx, name, &err)))
+        return RedisModule_ReplyWithError(ctx, err);
+
+    TSFilter filters[argc - 1];
+    if (ts_index_filters(ctx, name, &argv[2], argc - 2, filters) != REDISMODULE_OK)
+        return exit_status(RedisModule_ReplyWithError(ctx, "ERR invalid filter: must be label=value or label!=value"));
+    ts_doc_meta_filters(conf, filters, argc - 2);
+
+    size_t nentities, nfields = doc_group(conf) ? 1 : cJSON_GetArraySize(cJSON_GetObjectItem(conf, "ts_fields"));
+    RedisModuleString **entities = ts_index_query(ctx, name, filters, argc - 2, &nentities);
+    RedisModuleString *series[nfields];
+    long len = 0;
+
+    RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+    for (size_t i = 0; i < nentities; i++) {
+        size_t n = ts_entity_series(ctx, name, entities[i], conf, filters, argc - 2, series);
+        for (size_t j = 0; j < n; j++)
+            RedisModule_ReplyWithString(ctx, series[j]);
+        len += n;
     }
+    RedisModule_ReplySetArrayLength(ctx, len);
+    RedisModule_Free(entities);
+
+    return exit_status(REDISMODULE_OK);
+}
 
-    return exit_status(RedisModule_ReplyWithSimpleString(ctx, "OK"));
+static void ts_reply_entry(RedisModuleCtx *ctx, TSEntry *e, Operation op) {
+    if (op == op_avg)
+        RedisModule_ReplyWithDouble(ctx, e->avg);
+    else if (op == op_sum)
+        RedisModule_ReplyWithDouble(ctx, e->avg * e->count);
+    else
+        RedisModule_ReplyWithLongLong(ctx, e->count);
+}
+
+/* Reply with a value per bucket, or with an array of values per bucket when cols is given */
+void ts_reply_range(RedisModuleCtx *ctx, TSRange *r, Operation op, const size_t *cols, size_t ncols) {
+    RedisModule_ReplyWithArray(ctx, r->len);
+    for (size_t i = 0; i < r->len; i++) {
+        if (!cols) {
+            ts_reply_entry(ctx, ts_range_entry(r, i, 0), op);
+            continue;
+        }
+        RedisModule_ReplyWithArray(ctx, ncols);
+        for (size_t j = 0; j < ncols; j++)
+            ts_reply_entry(ctx, ts_range_entry(r, i, cols[j]), op);
+    }
+}
+
+/* Reply with a single bulk string of packed buckets, see ts_range_pack */
+void ts_reply_packed(RedisModuleCtx *ctx, TSRange *r, const size_t *cols, size_t ncols) {
+    size_t len = r->len * ncols * TS_PACKED_ENTRY;
+    char *buf = RedisModule_Alloc(len ? len : 1);
+
+    RedisModule_ReplyWithStringBuffer(ctx, buf, ts_range_pack(r, cols, ncols, buf));
+    RedisModule_Free(buf);
+}
+
+/* Long TS.GET range served by a worker, from chunks pinned on the main thread */
+typedef struct TSGetJob {
+    RedisModuleBlockedClient *bc;
+    Operation op;
+    int binary;
+    TSRange range;
+    size_t ncols;
+    size_t cols[TS_MAX_COLUMNS];
+} TSGetJob;
+
+/* Replies to the thread safe context of a blocked client don't need the redis lock,
+ * they are handed to the client when it's unblocked */
+void ts_get_job(void *arg) {
+    TSGetJob *job = arg;
+    RedisModuleCtx *ctx = RedisModule_GetThreadSafeContext(job->bc);
+
+    if (job->binary)
+        ts_reply_packed(ctx, &job->range, job->cols, job->ncols);
+    else
+        ts_reply_range(ctx, &job->range, job->op, job->ncols ? job->cols : NULL, job->ncols);
+    RedisModule_FreeThreadSafeContext(ctx);
+    RedisModule_UnblockClient(job->bc, NULL);
+
+    ts_range_release(&job->range);
+    RedisModule_Free(job);
 }
 
 int TSGet(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RedisModule_AutoMemory(ctx);
 
-    if (argc < 3 || argc > 5)
+    // Optional trailing COLUMNS name [name ...] projection, optionally preceded by FORMAT TEXT|BINARY
+    int proj = RMUtil_ArgExists("COLUMNS", argv, argc, 3);
+    int fmt = RMUtil_ArgExists("FORMAT", argv, proj ? proj : argc, 3);
+    int nargs = fmt ? fmt : proj ? proj : argc;
+    if (nargs < 3 || nargs > 5 || proj == argc - 1 || (fmt && fmt + 2 != (proj ? proj : argc)))
         return RedisModule_WrongArity(ctx);
 
+    int binary = 0;
+    if (fmt) {
+        const char *name = RedisModule_StringPtrLen(argv[fmt + 1], NULL);
+        if (!strcasecmp(name, "BINARY"))
+            binary = 1;
+        else if (strcasecmp(name, "TEXT"))
+            return RedisModule_ReplyWithError(ctx,"ERR invalid format: must be one of text, binary");
+    }
+
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ|REDISMODULE_WRITE);
 
     if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY)
@@ -269,15 +909,17 @@ int TSGet(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     if (RedisModule_ModuleTypeGetType(key) != TSType)
         return RedisModule_ReplyWithError(ctx,"Invalid key type");
 
-    char *op = (char*)RedisModule_StringPtrLen(argv[2], NULL);
+    Operation op = str2op(RedisModule_StringPtrLen(argv[2], NULL));
+    if (op == op_none)
+        return RedisModule_ReplyWithError(ctx,"ERR invalid operation: must be one of avg, sum, count");
     struct TSObject *tso = RedisModule_ModuleTypeGetValue(key);
 
-    const char *timestamp = (argc > 3) ? (char*)RedisModule_StringPtrLen(argv[3], NULL) : NULL;
+    const char *timestamp = (nargs > 3) ? (char*)RedisModule_StringPtrLen(argv[3], NULL) : NULL;
 
     size_t from = idx_timestamp(tso->init_timestamp,
     	interval2timestamp(tso->interval, timestamp, tso->timefmt), tso->interval);
 
-    size_t to = (argc < 5) ? from : idx_timestamp(tso->init_timestamp,
+    size_t to = (nargs < 5) ? from : idx_timestamp(tso->init_timestamp,
         interval2timestamp(tso->interval, (char*)RedisModule_StringPtrLen(argv[4], NULL), tso->timefmt), tso->interval);
 
     if (tso->len <= to)
@@ -292,22 +934,545 @@ int TSGet(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     if (to < from)
         return RedisModule_ReplyWithError(ctx,"ERR invalid range: end before start");
 
-    RedisModule_ReplyWithArray(ctx,to - from + 1);
-    for (size_t i = from; i <= to; i++) {
-        TSEntry *e = &tso->entry[i];
-        if (!strcmp(op, AVG))
-            RedisModule_ReplyWithDouble(ctx, e->avg);
-        else if (!strcmp(op, SUM))
-            RedisModule_ReplyWithDouble(ctx, e->avg * e->count);
-        else if (!strcmp(op, COUNT))
-            RedisModule_ReplyWithLongLong(ctx, e->count);
+    // The projected columns, or every column of a multi column series
+    size_t cols[TS_MAX_COLUMNS];
+    size_t ncols = proj ? argc - proj - 1 : tso->columns ? tso->ncols : 0;
+    if (ncols > TS_MAX_COLUMNS)
+        return RedisModule_ReplyWithError(ctx,"ERR invalid columns: too many columns");
+    for (size_t i = 0; i < ncols; i++) {
+        int col = proj ? ts_column(tso, RedisModule_StringPtrLen(argv[proj + 1 + i], NULL)) : (int)i;
+        if (col < 0)
+            return RedisModule_ReplyWithError(ctx,"ERR invalid columns: no such column");
+        cols[i] = col;
+    }
+    // Packed buckets of a single value series hold its only column
+    if (binary && !ncols)
+        cols[ncols++] = 0;
+
+    size_t count = to - from + 1;
+    if (ts_can_block(ctx) && ts_options.async_get && count >= ts_options.async_get) {
+        // Pin the range, the reply is built on a worker
+        TSGetJob *job = RedisModule_Alloc(sizeof(*job));
+        job->op = op;
+        job->binary = binary;
+        job->ncols = ncols;
+        memcpy(job->cols, cols, sizeof(size_t) * ncols);
+        ts_range_pin(tso, from, count, &job->range);
+        job->bc = RedisModule_BlockClient(ctx, NULL, NULL, NULL, 0);
+        ts_pool_submit(ts_get_job, job);
+        return REDISMODULE_OK;
+    }
+
+    TSRange range;
+    ts_range_pin(tso, from, count, &range);
+    if (binary)
+        ts_reply_packed(ctx, &range, cols, ncols);
+    else
+        ts_reply_range(ctx, &range, op, ncols ? cols : NULL, ncols);
+    ts_range_release(&range);
+    return REDISMODULE_OK;
+}
+
+/* Add column 'column' of series 'name' (column 0 if NULL) to the len buckets starting at from,
+ * if the series matches the meta filters */
+static void ts_mrange_add(RedisModuleCtx *ctx, RedisModuleString *name, const char *column, Interval interval,
+                          time_t from, size_t len, double *sum, double *count, TSFilter *filters, int nfilters) {
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, name, REDISMODULE_READ);
+
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY || RedisModule_ModuleTypeGetType(key) != TSType) {
+        RedisModule_CloseKey(key);
+        return;
+    }
+    struct TSObject *tso = RedisModule_ModuleTypeGetValue(key);
+    int col = column ? ts_column(tso, column) : 0;
+
+    // Align the series on the reply buckets
+    size_t skip = 0, first = 0;
+    if (from >= tso->init_timestamp)
+        first = idx_timestamp(tso->init_timestamp, from, interval);
+    else
+        skip = idx_timestamp(from, tso->init_timestamp, interval);
+
+    if (col >= 0 && tso->interval == interval && skip < len && first < tso->len &&
+        ts_meta_match(tso, filters, nfilters)) {
+        TSRange range;
+        ts_range_pin(tso, first, len - skip < tso->len - first ? len - skip : tso->len - first, &range);
+        ts_range_merge(&range, col, &sum[skip], &count[skip]);
+        ts_range_release(&range);
+    }
+    RedisModule_CloseKey(key);
+}
+
+/**
+ * TS.MRANGE <name> [FILTER label=value|label!=value ...] FIELD <ts field> AGG <sum|avg|count> [GROUPBY <label>]
+ *           <start_time> <end_time>
+ * Aggregate a ts field of every series of doc 'name' matching the filters, merging the buckets into a single
+ * series per value of the GROUPBY label.
+ * */
+int TSMRange(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    cJSON *conf = NULL;
+    double *sum = NULL, *count = NULL;
+    RedisModuleString **groups = NULL;
+    const char *err;
+
+    int exit_status(int status) {
+        cJSON_Delete(conf);
+        RedisModule_Free(sum);
+        RedisModule_Free(count);
+        RedisModule_Free(groups);
+        return status;
+    }
+
+    if (argc < 8)
+        return RedisModule_WrongArity(ctx);
+    RedisModule_AutoMemory(ctx);
+
+    const char *name = RedisModule_StringPtrLen(argv[1], NULL);
+    const char *field = NULL, *groupby = NULL;
+    Operation op = op_none;
+    RedisModuleString *terms[argc];
+    int nterms = 0, in_filter = 0;
+
+    for (int i = 2; i < argc - 2; i++) {
+        const char *arg = RedisModule_StringPtrLen(argv[i], NULL);
+        int has_value = i + 1 < argc - 2;
+        if (!strcasecmp(arg, "FILTER")) {
+            in_filter = 1;
+            continue;
+        }
+        if (!strcasecmp(arg, "FIELD") && has_value)
+            field = RedisModule_StringPtrLen(argv[++i], NULL);
+        else if (!strcasecmp(arg, "AGG") && has_value)
+            op = str2op(RedisModule_StringPtrLen(argv[++i], NULL));
+        else if (!strcasecmp(arg, "GROUPBY") && has_value)
+            groupby = RedisModule_StringPtrLen(argv[++i], NULL);
+        else if (in_filter) {
+            terms[nterms++] = argv[i];
+            continue;
+        } else
+            return RedisModule_ReplyWithError(ctx, "ERR syntax error");
+        in_filter = 0;
+    }
+    if (!field)
+        return RedisModule_ReplyWithError(ctx, "ERR missing FIELD");
+    if (op == op_none)
+        return RedisModule_ReplyWithError(ctx,"ERR invalid operation: must be one of avg, sum, count");
+
+    if (!(conf = ts_doc_conf(ctx, name, &err)))
+        return RedisModule_ReplyWithError(ctx, err);
+
+    TSFilter filters[nterms + 1];
+    if (ts_index_filters(ctx, name, terms, nterms, filters) != REDISMODULE_OK)
+        return exit_status(RedisModule_ReplyWithError(ctx, "ERR invalid filter: must be label=value or label!=value"));
+    ts_doc_meta_filters(conf, filters, nterms);
+
+    Interval interval = str2interval(cJSON_GetObjectItem(conf, "interval")->valuestring);
+    TSTimeFmt timefmt;
+    ts_timefmt_compile(&timefmt, doc_timefmt(conf));
+    time_t from = interval2timestamp(interval, RedisModule_StringPtrLen(argv[argc - 2], NULL), &timefmt);
+    time_t to = interval2timestamp(interval, RedisModule_StringPtrLen(argv[argc - 1], NULL), &timefmt);
+    if (!from || !to)
+        return exit_status(RedisModule_ReplyWithError(ctx,"ERR invalid value: Time Stamp is not valid"));
+    if (to < from)
+        return exit_status(RedisModule_ReplyWithError(ctx,"ERR invalid range: end before start"));
+    size_t len = idx_timestamp(from, to, interval) + 1;
+    if (len > TS_MAX_ENTRIES)
+        return exit_status(RedisModule_ReplyWithError(ctx,"ERR invalid range: too many buckets"));
+
+    int group = doc_group(conf);
+    size_t ngroups = 1;
+    if (groupby)
+        groups = ts_index_values(ctx, name, groupby, &ngroups);
+    sum = RedisModule_Alloc(sizeof(double) * len);
+    count = RedisModule_Alloc(sizeof(double) * len);
+
+    long nreplies = 0;
+    RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+    for (size_t g = 0; g < ngroups; g++) {
+        // A group is the query narrowed to one value of the GROUPBY label
+        if (groupby)
+            filters[nterms] = (TSFilter){ .negate = 0, .set = RedisModule_CreateStringPrintf(ctx,
+                "%s" TS_INDEX_SUFFIX ":%s=%s", name, groupby, RedisModule_StringPtrLen(groups[g], NULL)) };
+
+        size_t n;
+        RedisModuleString **entities = ts_index_query(ctx, name, filters, nterms + (groupby != NULL), &n);
+        if (!n) {
+            RedisModule_Free(entities);
+            continue;
+        }
+
+        memset(sum, 0, sizeof(double) * len);
+        memset(count, 0, sizeof(double) * len);
+        for (size_t i = 0; i < n; i++) {
+            RedisModuleString *key = group ? entities[i] :
+                RedisModule_CreateStringPrintf(ctx, "%s:%s", RedisModule_StringPtrLen(entities[i], NULL), field);
+            ts_mrange_add(ctx, key, group ? field : NULL, interval, from, len, sum, count, filters, nterms);
+        }
+        RedisModule_Free(entities);
+
+        if (op == op_avg)
+            for (size_t i = 0; i < len; i++)
+                sum[i] = count[i] ? sum[i] / count[i] : 0;
+
+        RedisModule_ReplyWithArray(ctx, 2);
+        if (groupby)
+            RedisModule_ReplyWithString(ctx, groups[g]);
         else
-            return RedisModule_ReplyWithError(ctx,"ERR invalid operation: must be one of avg, sum, count");
+            RedisModule_ReplyWithSimpleString(ctx, "*");
+        RedisModule_ReplyWithArray(ctx, len);
+        for (size_t i = 0; i < len; i++) {
+            if (op == op_count)
+                RedisModule_ReplyWithLongLong(ctx, count[i]);
+            else
+                RedisModule_ReplyWithDouble(ctx, sum[i]);
+        }
+        nreplies++;
+    }
+    RedisModule_ReplySetArrayLength(ctx, nreplies);
+
+    return exit_status(REDISMODULE_OK);
+}
+
+/* Clip the buckets of [start, end] to those of tso. Sets the first bucket and the number of buckets, 0 if the
+ * range is outside of the series, or returns an error. */
+static const char *ts_range_clip(struct TSObject *tso, RedisModuleString *start_str, RedisModuleString *end_str,
+                                 size_t *from, size_t *len) {
+    time_t start = interval2timestamp(tso->interval, RedisModule_StringPtrLen(start_str, NULL), tso->timefmt);
+    time_t end = interval2timestamp(tso->interval, RedisModule_StringPtrLen(end_str, NULL), tso->timefmt);
+    if (!start || !end)
+        return "ERR invalid value: Time Stamp is not valid";
+    if (end < start)
+        return "ERR invalid range: end before start";
+
+    *from = start < tso->init_timestamp ? 0 : idx_timestamp(tso->init_timestamp, start, tso->interval);
+    size_t to = end < tso->init_timestamp ? 0 : idx_timestamp(tso->init_timestamp, end, tso->interval);
+    if (to >= tso->len)
+        to = tso->len - 1;
+
+    *len = !tso->len || end < tso->init_timestamp || *from > to ? 0 : to - *from + 1;
+    return NULL;
+}
+
+/**
+ * TS.SCAN <name> <start_time> <end_time> [AGG avg|sum|count] [COUNT n] [CURSOR c]
+ * Page through a range, at most COUNT buckets per call. Replies with the cursor of the next page,
+ * 0 once the range is done, followed by the buckets of this page. The cursor is a bucket index.
+ * */
+int TSScan(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc < 4 || argc % 2)
+        return RedisModule_WrongArity(ctx);
+
+    long long count = TS_SCAN_COUNT, cursor = 0;
+    Operation op = op_avg;
+    for (int i = 4; i < argc; i += 2) {
+        const char *arg = RedisModule_StringPtrLen(argv[i], NULL);
+        if (!strcasecmp(arg, "COUNT")) {
+            if (RedisModule_StringToLongLong(argv[i + 1], &count) != REDISMODULE_OK || count < 1 ||
+                count > TS_MAX_ENTRIES)
+                return RedisModule_ReplyWithError(ctx, "ERR invalid count");
+        } else if (!strcasecmp(arg, "CURSOR")) {
+            if (RedisModule_StringToLongLong(argv[i + 1], &cursor) != REDISMODULE_OK || cursor < 0)
+                return RedisModule_ReplyWithError(ctx, "ERR invalid cursor");
+        } else if (!strcasecmp(arg, "AGG")) {
+            if ((op = str2op(RedisModule_StringPtrLen(argv[i + 1], NULL))) == op_none)
+                return RedisModule_ReplyWithError(ctx,"ERR invalid operation: must be one of avg, sum, count");
+        } else {
+            return RedisModule_ReplyWithError(ctx, "ERR syntax error");
+        }
     }
 
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ|REDISMODULE_WRITE);
+
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY)
+        return RedisModule_ReplyWithError(ctx,"Key doesn't exist");
+
+    if (RedisModule_ModuleTypeGetType(key) != TSType)
+        return RedisModule_ReplyWithError(ctx,"Invalid key type");
+    struct TSObject *tso = RedisModule_ModuleTypeGetValue(key);
+
+    size_t from, len;
+    const char *err = ts_range_clip(tso, argv[2], argv[3], &from, &len);
+    if (err)
+        return RedisModule_ReplyWithError(ctx, err);
+
+    // Resume after the previous page
+    if ((size_t)cursor > from) {
+        size_t skip = (size_t)cursor - from < len ? (size_t)cursor - from : len;
+        from += skip;
+        len -= skip;
+    }
+
+    RedisModule_ReplyWithArray(ctx, 2);
+    if (!len) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return RedisModule_ReplyWithArray(ctx, 0);
+    }
+
+    size_t n = len < (size_t)count ? len : (size_t)count;
+    RedisModule_ReplyWithLongLong(ctx, n < len ? from + n : 0);
+
+    size_t cols[TS_MAX_COLUMNS];
+    size_t ncols = tso->columns ? tso->ncols : 0;
+    for (size_t i = 0; i < ncols; i++)
+        cols[i] = i;
+
+    TSRange range;
+    ts_range_pin(tso, from, n, &range);
+    ts_reply_range(ctx, &range, op, ncols ? cols : NULL, ncols);
+    ts_range_release(&range);
     return REDISMODULE_OK;
 }
 
+/* Open a file argument inside FILE_DIR with flags. Only relative paths without ".." are taken, and every component
+ * is opened without following links, so a client can't reach the RDB, the config or any other file of the server
+ * even through a link in FILE_DIR. Returns the descriptor, or -1 with *err set, or with errno set if the file can't
+ * be opened. */
+static int ts_file_open(RedisModuleString *arg, int flags, const char **err) {
+    const char *path = RedisModule_StringPtrLen(arg, NULL);
+
+    *err = NULL;
+    if (!ts_options.file_dir) {
+        *err = "ERR file access is disabled: the FILE_DIR module option isn't set";
+        return -1;
+    }
+    int escapes = *path == '/';
+    for (const char *p = path; !escapes && *p; p += strspn(p, "/")) {
+        size_t n = strcspn(p, "/");
+        escapes = n == 2 && !strncmp(p, "..", 2);
+        p += n;
+    }
+    if (escapes) {
+        *err = "ERR invalid path: must be relative to FILE_DIR, without ..";
+        return -1;
+    }
+
+    int dir = open(ts_options.file_dir, O_RDONLY | O_DIRECTORY), fd, saved;
+    for (const char *p = path; dir >= 0; ) {
+        size_t n = strcspn(p, "/");
+        const char *next = p + n + strspn(p + n, "/");
+        if (n > NAME_MAX) {
+            close(dir);
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        char name[n + 1];
+        memcpy(name, p, n);
+        name[n] = '\0';
+        if (*next)
+            fd = openat(dir, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+        else
+            fd = openat(dir, name, flags | O_NOFOLLOW, 0644);
+        saved = errno;
+        close(dir);
+        errno = saved;
+        if (!*next)
+            return fd;
+        dir = fd;
+        p = next;
+    }
+    return -1;
+}
+
+/**
+ * TS.EXPORT <name> <start_time> <end_time> ARROW [path]
+ * Reply with the range as an Arrow IPC stream, or write it to a file on the server and reply with its size.
+ * */
+int TSExport(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc < 5 || argc > 6)
+        return RedisModule_WrongArity(ctx);
+
+    if (strcasecmp(RedisModule_StringPtrLen(argv[4], NULL), "ARROW"))
+        return RedisModule_ReplyWithError(ctx,"ERR invalid format: must be arrow");
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ|REDISMODULE_WRITE);
+
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY)
+        return RedisModule_ReplyWithError(ctx,"Key doesn't exist");
+
+    if (RedisModule_ModuleTypeGetType(key) != TSType)
+        return RedisModule_ReplyWithError(ctx,"Invalid key type");
+    struct TSObject *tso = RedisModule_ModuleTypeGetValue(key);
+
+    size_t from, len;
+    const char *err = ts_range_clip(tso, argv[2], argv[3], &from, &len);
+    if (err)
+        return RedisModule_ReplyWithError(ctx, err);
+
+    TSRange range;
+    size_t size;
+    ts_range_pin(tso, from, len, &range);
+    char *stream = ts_arrow_stream(tso, &range, from, &size);
+    ts_range_release(&range);
+
+    if (argc == 5) {
+        RedisModule_ReplyWithStringBuffer(ctx, stream, size);
+        RedisModule_Free(stream);
+        return REDISMODULE_OK;
+    }
+
+    const char *path = RedisModule_StringPtrLen(argv[5], NULL);
+    int fd = ts_file_open(argv[5], O_WRONLY | O_CREAT | O_TRUNC, &err);
+    if (fd < 0 && err) {
+        RedisModule_Free(stream);
+        return RedisModule_ReplyWithError(ctx, err);
+    }
+    FILE *fp = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (fd >= 0 && !fp)
+        close(fd);
+    int ok = fp && fwrite(stream, 1, size, fp) == size;
+    if (fp && fclose(fp))
+        ok = 0;
+    RedisModule_Free(stream);
+    if (!ok) {
+        RedisModuleString *ret = RedisModule_CreateStringPrintf(ctx, "ERR can't write %s: %s", path, strerror(errno));
+        return RedisModule_ReplyWithError(ctx, RedisModule_StringPtrLen(ret, NULL));
+    }
+    return RedisModule_ReplyWithLongLong(ctx, size);
+}
+
+/**
+ * TS.IMPORT <name> FILE <path>|BLOB <data> FORMAT csv|bin
+ * Backfill a series from a file on the server or from the argument, see ts_import for the formats.
+ * Replies with the number of rows imported.
+ * */
+int TSImport(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc != 6)
+        return RedisModule_WrongArity(ctx);
+
+    const char *source = RedisModule_StringPtrLen(argv[2], NULL);
+    int file = !strcasecmp(source, "FILE");
+    if (!file && strcasecmp(source, "BLOB"))
+        return RedisModule_ReplyWithError(ctx,"ERR invalid source: must be one of file, blob");
+
+    const char *format_str = RedisModule_StringPtrLen(argv[5], NULL);
+    if (strcasecmp(RedisModule_StringPtrLen(argv[4], NULL), "FORMAT") ||
+        (strcasecmp(format_str, "csv") && strcasecmp(format_str, "bin")))
+        return RedisModule_ReplyWithError(ctx,"ERR invalid format: must be one of csv, bin");
+    TSImportFormat format = strcasecmp(format_str, "csv") ? ts_import_bin : ts_import_csv;
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ|REDISMODULE_WRITE);
+
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY)
+        return RedisModule_ReplyWithError(ctx,"Key doesn't exist");
+
+    if (RedisModule_ModuleTypeGetType(key) != TSType)
+        return RedisModule_ReplyWithError(ctx,"Invalid key type");
+    struct TSObject *tso = RedisModule_ModuleTypeGetValue(key);
+
+    size_t len, rows;
+    const char *data = RedisModule_StringPtrLen(argv[3], &len), *err;
+    int fd = -1;
+    if (file) {
+        struct stat st;
+        if ((fd = ts_file_open(argv[3], O_RDONLY, &err)) < 0 && err)
+            return RedisModule_ReplyWithError(ctx, err);
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            RedisModuleString *ret = RedisModule_CreateStringPrintf(ctx, "ERR can't read %s: %s", data,
+                                                                     strerror(errno));
+            if (fd >= 0)
+                close(fd);
+            return RedisModule_ReplyWithError(ctx, RedisModule_StringPtrLen(ret, NULL));
+        }
+        len = st.st_size;
+        data = len ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0) : "";
+        if (data == MAP_FAILED) {
+            close(fd);
+            return RedisModule_ReplyWithError(ctx,"ERR can't map the file");
+        }
+    }
+
+    err = ts_import(tso, data, len, format, &rows);
+
+    if (file) {
+        if (len)
+            munmap((void *)data, len);
+        close(fd);
+    }
+    if (err) {
+        RedisModuleString *ret = RedisModule_CreateStringPrintf(ctx, "%s (row %zu)", err, rows);
+        return RedisModule_ReplyWithError(ctx, RedisModule_StringPtrLen(ret, NULL));
+    }
+    return RedisModule_ReplyWithLongLong(ctx, rows);
+}
+
+/* TS.RESTORE key SERIES interval init_timestamp len timefmt columns | META meta | OFFSET source partition offset |
+ *            CHUNK n entries
+ * Rebuild a series part by part, as the AOF rewrite emits it. SERIES replaces the key, columns and meta are NUL
+ * terminated strings back to back, entries are the raw chunk the RDB saves. */
+int TSRestore(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc < 4)
+        return RedisModule_WrongArity(ctx);
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ|REDISMODULE_WRITE);
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != TSType)
+        return RedisModule_ReplyWithError(ctx, "key is not time series");
+
+    const char *part = RedisModule_StringPtrLen(argv[2], NULL), *buf;
+    size_t len;
+    if (!strcasecmp(part, "SERIES")) {
+        long long interval, init_timestamp, entries;
+        if (argc != 8)
+            return RedisModule_WrongArity(ctx);
+        if (RedisModule_StringToLongLong(argv[3], &interval) != REDISMODULE_OK || !interval2str(interval) ||
+            RedisModule_StringToLongLong(argv[4], &init_timestamp) != REDISMODULE_OK ||
+            RedisModule_StringToLongLong(argv[5], &entries) != REDISMODULE_OK || entries < 0)
+            return RedisModule_ReplyWithError(ctx, "ERR invalid value: expecting an interval, a start and a length");
+
+        buf = RedisModule_StringPtrLen(argv[7], &len);
+        size_t ncols = 0;
+        for (size_t i = 0; i < len; i++)
+            ncols += !buf[i];
+        if (ncols > TS_MAX_COLUMNS || (len && buf[len - 1]))
+            return RedisModule_ReplyWithError(ctx, "ERR invalid value: expecting up to 64 columns");
+        const char *columns[ncols ? ncols : 1];
+        for (size_t i = 0; i < ncols; i++, buf += strlen(buf) + 1)
+            columns[i] = buf;
+
+        struct TSObject *tso = ts_create_object(key, interval,
+                                                ts_timefmt_new(RedisModule_StringPtrLen(argv[6], NULL)),
+                                                init_timestamp);
+        tso->len = entries;
+        if (ncols)
+            ts_set_columns(tso, ncols, columns);
+        return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    }
+
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY)
+        return RedisModule_ReplyWithError(ctx, "key doesn't exist");
+    struct TSObject *tso = RedisModule_ModuleTypeGetValue(key);
+    if (!strcasecmp(part, "META") && argc == 4) {
+        buf = RedisModule_StringPtrLen(argv[3], &len);
+        if (ts_set_meta_buf(tso, buf, len) != REDISMODULE_OK)
+            return RedisModule_ReplyWithError(ctx, "ERR invalid value: expecting label=value metadata");
+    } else if (!strcasecmp(part, "OFFSET") && argc == 6) {
+        long long partition, offset;
+        if (RedisModule_StringToLongLong(argv[4], &partition) != REDISMODULE_OK ||
+            RedisModule_StringToLongLong(argv[5], &offset) != REDISMODULE_OK ||
+            partition < 0 || partition > UINT32_MAX || offset < 0)
+            return RedisModule_ReplyWithError(ctx, "ERR invalid value: expecting a partition and an offset");
+        ts_offset_set(tso, RedisModule_StringPtrLen(argv[3], NULL), partition, offset);
+    } else if (!strcasecmp(part, "CHUNK") && argc == 5) {
+        long long n;
+        const char *err;
+        buf = RedisModule_StringPtrLen(argv[4], &len);
+        if (RedisModule_StringToLongLong(argv[3], &n) != REDISMODULE_OK || n < 0)
+            return RedisModule_ReplyWithError(ctx, "ERR invalid value: expecting a chunk number");
+        if ((err = ts_restore_chunk(tso, n, buf, len)))
+            return RedisModule_ReplyWithError(ctx, err);
+    } else {
+        return RedisModule_ReplyWithError(ctx, "ERR invalid part: must be one of series, meta, offset, chunk");
+    }
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
+
 int TSInfo(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RedisModule_AutoMemory(ctx);
     char starttimestr[64], endtimestr[64];
@@ -329,22 +1494,50 @@ int TSInfo(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     time_t endtime = tso->init_timestamp + tso->interval * idx;
     struct tm st;
 
-    localtime_r(&tso->init_timestamp, &st);
-    strftime(starttimestr, 64, tso->timefmt, &st);
-    localtime_r(&endtime, &st);
-    strftime(endtimestr, 64, tso->timefmt, &st);
+    gmtime_r(&tso->init_timestamp, &st);
+    strftime(starttimestr, 64, tso->timefmt->format, &st);
+    gmtime_r(&endtime, &st);
+    strftime(endtimestr, 64, tso->timefmt->format, &st);
 
     RedisModuleString *ret = RedisModule_CreateStringPrintf(ctx, "Start: %s End: %s len: %zu Interval: %s",
         starttimestr, endtimestr, tso->len, interval2str(tso->interval));
+    for (size_t i = 0; tso->columns && i < tso->ncols; i++) {
+        const char *sep = i ? "," : " Columns: ";
+        RedisModule_StringAppendBuffer(ctx, ret, sep, strlen(sep));
+        RedisModule_StringAppendBuffer(ctx, ret, ts_column_name(tso, i), strlen(ts_column_name(tso, i)));
+    }
+    for (size_t i = 0; i < tso->nmeta * 2; i++) {
+        const char *sep = !i ? " Meta: " : i % 2 ? "=" : ",";
+        RedisModule_StringAppendBuffer(ctx, ret, sep, strlen(sep));
+        RedisModule_StringAppendBuffer(ctx, ret, ts_intern_str(tso->meta[i]), strlen(ts_intern_str(tso->meta[i])));
+    }
+    if (tso->late || tso->future) {
+        char outliers[64];
+        int len = snprintf(outliers, sizeof(outliers), " Late: %zu Future: %zu", tso->late, tso->future);
+        RedisModule_StringAppendBuffer(ctx, ret, outliers, len);
+    }
     return RedisModule_ReplyWithString(ctx, ret);
 
 }
 
-int RedisModule_OnLoad(RedisModuleCtx *ctx) {
+int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     // Register the timeseries module itself
     if (RedisModule_Init(ctx, "ts", 1, REDISMODULE_APIVER_1) == REDISMODULE_ERR)
         return REDISMODULE_ERR;
 
+    if (ts_options_load(ctx, argv, argc) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
+    if (ts_options.threads && !RedisModule_BlockClient) {
+        RedisModule_Log(ctx, "warning", "This redis version can't block clients, TS.INSERTDOC runs on the main thread");
+    } else if (ts_pool_start(ts_options.threads) == REDISMODULE_ERR) {
+        RedisModule_Log(ctx, "warning", "Failed to start worker threads");
+        return REDISMODULE_ERR;
+    }
+
+    if (ts_options.cold_dir && ts_cold_open(ctx) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+
     TSType = create_ts_entry_type(ctx);
     if (TSType == NULL) return REDISMODULE_ERR;
 
@@ -353,10 +1546,16 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
     RMUtil_RegisterWriteCmd(ctx, "ts.insert", TSInsert);
     RMUtil_RegisterWriteCmd(ctx, "ts.get", TSGet);
     RMUtil_RegisterWriteCmd(ctx, "ts.info", TSInfo);
+    RMUtil_RegisterWriteCmd(ctx, "ts.scan", TSScan);
+    RMUtil_RegisterWriteCmd(ctx, "ts.export", TSExport);
+    RMUtil_RegisterWriteCmd(ctx, "ts.import", TSImport);
+    RMUtil_RegisterWriteCmd(ctx, "ts.restore", TSRestore);
 
     // Register timeseries doc api
     RMUtil_RegisterWriteCmd(ctx, "ts.createdoc", TSCreateDoc);
     RMUtil_RegisterWriteCmd(ctx, "ts.insertdoc", TSInsertDoc);
+    RMUtil_RegisterWriteCmd(ctx, "ts.queryindex", TSQueryIndex);
+    RMUtil_RegisterWriteCmd(ctx, "ts.mrange", TSMRange);
 
     // register the unit test
     RMUtil_RegisterWriteCmd(ctx, "ts.test", TestModule);
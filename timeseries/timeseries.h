@@ -1,11 +1,12 @@
 #ifndef _TIMESERIES_H_
 #define _TIMESERIES_H_
 
-#define _XOPEN_SOURCE // For the use of strptime
+#define _XOPEN_SOURCE 700 // For the use of strptime, and O_NOFOLLOW
 #include <time.h>
 
 #include <strings.h>
 
+#define REDISMODULE_EXPERIMENTAL_API // Blocked clients and thread safe contexts
 #include "../redismodule.h"
 #include "../rmutil/util.h"
 #include "../rmutil/strings.h"
@@ -23,6 +24,13 @@
 #define AVG "avg"
 #define COUNT "count"
 
+typedef enum {
+  op_none = 0,
+  op_sum,
+  op_avg,
+  op_count
+} Operation;
+
 #define DEFAULT_TIMEFMT "%Y:%m:%d %H:%M:%S"
 
 typedef enum {
@@ -37,6 +45,12 @@ typedef enum {
 
 #define TS_MAX_ENTRIES 1000000
 
+// Buckets per TS.SCAN page when COUNT isn't given
+#define TS_SCAN_COUNT 1000
+
+// Hard limit on keys derived from documents (prefix, key field values and ts field)
+#define TS_MAX_KEY_LEN 1024
+
 #define RMCALL(reply, call) \
   if (reply) \
     RedisModule_FreeCallReply(reply); \
@@ -98,6 +112,9 @@ Interval str2interval(const char *interval);
 
 const char *interval2str(Interval interval);
 
+// Cleared while the unit tests drive the commands through RedisModule_Call
+extern int ts_async_enabled;
+
 // Test function
 int TestModule(RedisModuleCtx *ctx, RedisModuleString **argv, int argc);
 
@@ -1,4 +1,10 @@
 #include "timeseries.h"
+#include "ts_cold.h"
+#include "ts_doc.h"
+#include "ts_entry.h"
+#include "ts_options.h"
+#include <pthread.h>
+#include <unistd.h>
 
 char *fmt = DEFAULT_TIMEFMT;
 
@@ -36,12 +42,84 @@ cJSON *dataJson(double s, double a) {
     cJSON *data = cJSON_CreateObject();
     cJSON_AddStringToObject(data, "userId", "userId1");
     cJSON_AddStringToObject(data, "accountId", "accountId1");
+    cJSON_AddStringToObject(data, "email", "user1@example.com");
     cJSON_AddNumberToObject(data, "pagesVisited", s);
     cJSON_AddNumberToObject(data, "storageUsed", 111);
     cJSON_AddNumberToObject(data, "trafficUsed", a);
     return data;
 }
 
+/* A document of another entity at a given time */
+cJSON *entityJson(const char *user, const char *account, const char *email, double s, const char *timestamp) {
+    cJSON *data = dataJson(s, 1);
+    cJSON_ReplaceItemInObject(data, "userId", cJSON_CreateString(user));
+    cJSON_ReplaceItemInObject(data, "accountId", cJSON_CreateString(account));
+    cJSON_ReplaceItemInObject(data, "email", cJSON_CreateString(email));
+    cJSON_AddStringToObject(data, "timestamp", timestamp);
+    return data;
+}
+
+/* A value of a reply, integer or double */
+double replyValue(RedisModuleCallReply *v) {
+    return RedisModule_CallReplyType(v) == REDISMODULE_REPLY_INTEGER ?
+        RedisModule_CallReplyInteger(v) : strtod(RedisModule_CallReplyStringPtr(v, NULL), NULL);
+}
+
+/* Do the values of group in a TS.MRANGE reply equal the n expected ones? */
+int mrangeEquals(RedisModuleCallReply *r, const char *group, const double *expected, size_t n) {
+    for (size_t i = 0; i < RedisModule_CallReplyLength(r); i++) {
+        RedisModuleCallReply *pair = RedisModule_CallReplyArrayElement(r, i);
+        RedisModuleCallReply *values = RedisModule_CallReplyArrayElement(pair, 1);
+        if (strcmp(RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(pair, 0), NULL), group))
+            continue;
+        if (RedisModule_CallReplyLength(values) != n)
+            return 0;
+        for (size_t j = 0; j < n; j++)
+            if (replyValue(RedisModule_CallReplyArrayElement(values, j)) != expected[j])
+                return 0;
+        return 1;
+    }
+    return 0;
+}
+
+/* Do the columns of the bucket of a TS.GET at timestamp equal the expected ones? */
+int bucketEquals(RedisModuleCtx *ctx, const char *key, const char *op, const char *timestamp, double a, double b) {
+    RedisModuleCallReply *r = RedisModule_Call(ctx, "TS.GET", "ccc", key, op, timestamp), *bucket;
+    int equal = r && RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ARRAY &&
+        (bucket = RedisModule_CallReplyArrayElement(r, 0)) && RedisModule_CallReplyLength(bucket) == 2 &&
+        replyValue(RedisModule_CallReplyArrayElement(bucket, 0)) == a &&
+        replyValue(RedisModule_CallReplyArrayElement(bucket, 1)) == b;
+    if (r)
+        RedisModule_FreeCallReply(r);
+    return equal;
+}
+
+/* Little endian integer of size bytes at p */
+uint64_t testLE(const char *p, int size) {
+    uint64_t v = 0;
+    for (int i = size - 1; i >= 0; i--)
+        v = v << 8 | (unsigned char)p[i];
+    return v;
+}
+
+/* Position of field i of the flatbuffer table t, or NULL if it's absent */
+const char *fbField(const char *t, int i) {
+    const char *vtable = t - (int32_t)testLE(t, 4);
+    size_t at = 4 + 2 * i < testLE(vtable, 2) ? testLE(vtable + 4 + 2 * i, 2) : 0;
+    return at ? t + at : NULL;
+}
+
+/* The table, vector or string the offset at p refers to */
+const char *fbDeref(const char *p) {
+    return p + testLE(p, 4);
+}
+
+/* The Message table of the encapsulated message at p, and the position of the message after it */
+const char *arrowMessage(const char *p, const char **next) {
+    *next = p + 8 + testLE(p + 4, 4);
+    return fbDeref(p + 8);
+}
+
 int testTSApi(RedisModuleCtx *ctx) {
     long count;
     double val;
@@ -62,6 +140,208 @@ int testTSApi(RedisModuleCtx *ctx) {
     val = strtod(RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(r, 0), NULL), &eptr);
     RMUtil_Assert(val == 11);
 
+    // Page through the range a bucket at a time
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.SCAN", "ccccccc", "tstestapi", "2016:01:01 00:00:00",
+        "2016:01:02 00:00:00", "AGG", "sum", "COUNT", "1"));
+    RMUtil_Assert(RedisModule_CallReplyInteger(RedisModule_CallReplyArrayElement(r, 0)) == 1);
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.SCAN", "ccccccccc", "tstestapi", "2016:01:01 00:00:00",
+        "2016:01:02 00:00:00", "AGG", "sum", "COUNT", "1", "CURSOR", "1"));
+    RMUtil_Assert(RedisModule_CallReplyInteger(RedisModule_CallReplyArrayElement(r, 0)) == 0);
+    val = strtod(RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(
+        RedisModule_CallReplyArrayElement(r, 1), 0), NULL), &eptr);
+    RMUtil_Assert(val == 22);
+
+    // An Arrow stream of a schema message, a record batch message and its body, and the end of stream marker
+    size_t len;
+    const char *msg, *next;
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.EXPORT", "cccc", "tstestapi", "2016:01:01 00:00:00",
+        "2016:01:02 00:00:00", "ARROW"));
+    const char *stream = RedisModule_CallReplyStringPtr(r, &len);
+    RMUtil_Assert(len % 8 == 0 && !memcmp(stream, "\xff\xff\xff\xff", 4));
+    msg = arrowMessage(stream, &next);
+    RMUtil_Assert(*fbField(msg, 1) == 1);
+    RMUtil_Assert(testLE(fbDeref(fbField(fbDeref(fbField(msg, 2)), 1)), 4) == 4);
+    msg = arrowMessage(next, &next);
+    RMUtil_Assert(*fbField(msg, 1) == 3);
+    RMUtil_Assert(testLE(fbField(fbDeref(fbField(msg, 2)), 0), 8) == 2);
+    size_t body_len = testLE(fbField(msg, 3), 8);
+    RMUtil_Assert(testLE(next, 8) == 1451606400 && testLE(next + 20, 4) == 2);
+    RMUtil_Assert(next + body_len + 8 == stream + len && !memcmp(next + body_len, "\xff\xff\xff\xff\0\0\0\0", 8));
+
+    // A replayed offset is rejected
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccccccc", "tstestapi", "1", "2016:01:02 00:00:00",
+        "OFFSET", "topic", "0", "7"));
+    RMCALL(r, RedisModule_Call(ctx, "TS.INSERT", "ccccccc", "tstestapi", "1", "2016:01:02 00:00:00",
+        "OFFSET", "topic", "0", "7"));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccccccc", "tstestapi", "1", "2016:01:02 00:00:00",
+        "OFFSET", "topic", "1", "7"));
+
+    // A key with its own time format
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "c", "tstestfmt"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.CREATE", "ccccc", "tstestfmt", "day", "2016-01-01T00:00:00",
+        "TIMEFMT", "%Y-%m-%dT%H:%M:%S"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccc", "tstestfmt", "4", "2016-01-02T10:00:00"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.GET", "ccc", "tstestfmt", "count", "2016-01-02T00:00:00"));
+    RMUtil_Assert(RedisModule_CallReplyInteger(RedisModule_CallReplyArrayElement(r, 0)) == 1);
+    RMCALL(r, RedisModule_Call(ctx, "TS.INSERT", "ccc", "tstestfmt", "4", "2016:01:02 10:00:00"));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+
+    // Digits only timestamps are read in a digits only format before they're taken for epoch seconds
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "c", "tstestfmt"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.CREATE", "ccccc", "tstestfmt", "hour", "2016010100",
+        "TIMEFMT", "%Y%m%d%H"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.IMPORT", "cccccc", "tstestfmt", "BLOB",
+        "2016010512,1\n1451995200,1\n", "FORMAT", "csv"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.GET", "ccc", "tstestfmt", "count", "2016010512"));
+    RMUtil_Assert(RedisModule_CallReplyInteger(RedisModule_CallReplyArrayElement(r, 0)) == 2);
+
+    return 0;
+}
+
+int testTSColumns(RedisModuleCtx *ctx) {
+    RedisModuleCallReply *r = NULL, *bucket;
+    char *eptr;
+
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "c", "tstestcolumns"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.CREATE", "cccccc", "tstestcolumns", "day", "2016:01:01 00:00:00",
+        "COLUMNS", "a", "b"));
+
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccccc", "tstestcolumns", "VALUES", "1", "10",
+        "2016:01:02 00:00:00"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccccc", "tstestcolumns", "VALUES", "2", "20",
+        "2016:01:02 00:01:00"));
+    RMCALL(r, RedisModule_Call(ctx, "TS.INSERT", "ccc", "tstestcolumns", "VALUES", "1"));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+
+    // Backfill a row per csv line
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.IMPORT", "cccccc", "tstestcolumns", "BLOB",
+        "2016:01:01 00:00:00,1,2\n1451995200,3,4\n", "FORMAT", "csv"));
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+    RMCALL(r, RedisModule_Call(ctx, "TS.IMPORT", "cccccc", "tstestcolumns", "BLOB", "1451995200,3\n",
+        "FORMAT", "csv"));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+
+    // Files are only read inside FILE_DIR
+    const char *file_dir = ts_options.file_dir;
+    ts_options.file_dir = "/tmp";
+    RMCALL(r, RedisModule_Call(ctx, "TS.IMPORT", "cccccc", "tstestcolumns", "FILE", "../etc/passwd",
+        "FORMAT", "csv"));
+    ts_options.file_dir = file_dir;
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+
+    // A file in FILE_DIR is imported like the same rows sent as a blob
+    char dir[] = "/tmp/tstestimportXXXXXX", path[64];
+    RMUtil_Assert(mkdtemp(dir));
+    snprintf(path, sizeof(path), "%s/rows.csv", dir);
+    FILE *f = fopen(path, "w");
+    RMUtil_Assert(f);
+    fputs("2016:01:06 00:00:00,5,6\n2016:01:06 00:01:00,1,2\n", f);
+    fclose(f);
+    ts_options.file_dir = dir;
+    RMCALL(r, RedisModule_Call(ctx, "TS.IMPORT", "cccccc", "tstestcolumns", "FILE", "rows.csv", "FORMAT", "csv"));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_INTEGER && RedisModule_CallReplyInteger(r) == 2);
+
+    // A link to a directory out of FILE_DIR isn't followed
+    char link[64];
+    snprintf(link, sizeof(link), "%s/etc", dir);
+    int linked = !symlink("/etc", link);
+    RMCALL(r, RedisModule_Call(ctx, "TS.IMPORT", "cccccc", "tstestcolumns", "FILE", "etc/passwd", "FORMAT", "csv"));
+    ts_options.file_dir = file_dir;
+    unlink(link);
+    unlink(path);
+    rmdir(dir);
+    RMUtil_Assert(linked && RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+    RMUtil_Assert(bucketEquals(ctx, "tstestcolumns", "sum", "2016:01:06 00:00:00", 6, 8));
+
+    // Binary rows: a little endian int64 timestamp and a float64 per column
+    char bin[2 * 24];
+    const double values[] = {1.5, 2, 3, 4.25};
+    for (int i = 0; i < 2; i++) {
+        uint64_t fields[3] = {1452038400 + i * 60};
+        memcpy(&fields[1], &values[i * 2], sizeof(double) * 2);
+        for (int j = 0; j < 3; j++)
+            for (int b = 0; b < 8; b++)
+                bin[i * 24 + j * 8 + b] = fields[j] >> (8 * b);
+    }
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.IMPORT", "ccbcc", "tstestcolumns", "BLOB", bin, sizeof(bin),
+        "FORMAT", "bin"));
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+    RMUtil_Assert(bucketEquals(ctx, "tstestcolumns", "sum", "2016:01:06 00:00:00", 10.5, 14.25));
+    RMUtil_Assert(bucketEquals(ctx, "tstestcolumns", "count", "2016:01:06 00:00:00", 4, 4));
+    RMCALL(r, RedisModule_Call(ctx, "TS.IMPORT", "ccbcc", "tstestcolumns", "BLOB", bin, sizeof(bin) - 1,
+        "FORMAT", "bin"));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+
+    // The last day of a month, right after a row of the month after, stays in its own month
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "c", "tstestmonths"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.CREATE", "ccc", "tstestmonths", "month", "2015:12:01 00:00:00"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.IMPORT", "cccccc", "tstestmonths", "BLOB",
+        "1451649600,1\n1451563200,1\n", "FORMAT", "csv"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.GET", "ccc", "tstestmonths", "count", "2015:12:15 00:00:00"));
+    RMUtil_Assert(RedisModule_CallReplyInteger(RedisModule_CallReplyArrayElement(r, 0)) == 1);
+
+    // A bucket counts past 65535 rows
+    const char row[] = "1451606400,1\n";
+    size_t nrows = 70000;
+    char *rows = RedisModule_Alloc(nrows * (sizeof(row) - 1) + 1);
+    for (size_t i = 0; i < nrows; i++)
+        memcpy(rows + i * (sizeof(row) - 1), row, sizeof(row));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "c", "tstestwide"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.CREATE", "ccc", "tstestwide", "day", "2016:01:01 00:00:00"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.IMPORT", "cccccc", "tstestwide", "BLOB", rows, "FORMAT", "csv"));
+    RedisModule_Free(rows);
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.GET", "ccc", "tstestwide", "count", "2016:01:01 00:00:00"));
+    RMUtil_Assert(RedisModule_CallReplyInteger(RedisModule_CallReplyArrayElement(r, 0)) == 70000);
+
+    // Project a single column
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.GET", "ccccc", "tstestcolumns", "sum", "2016:01:02 00:00:00",
+        "COLUMNS", "b"));
+    bucket = RedisModule_CallReplyArrayElement(r, 0);
+    RMUtil_Assert(RedisModule_CallReplyLength(bucket) == 1);
+    RMUtil_Assert(strtod(RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(bucket, 0), NULL),
+        &eptr) == 30);
+
+    // Packed buckets: uint32 count and float64 sum per column
+    size_t len;
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.GET", "ccccc", "tstestcolumns", "sum", "2016:01:02 00:00:00",
+        "FORMAT", "BINARY"));
+    const unsigned char *packed = (const unsigned char *)RedisModule_CallReplyStringPtr(r, &len);
+    RMUtil_Assert(len == 2 * TS_PACKED_ENTRY);
+    RMUtil_Assert(packed[TS_PACKED_ENTRY] == 2 && packed[TS_PACKED_ENTRY + 1] == 0);
+
+    RMCALL(r, RedisModule_Call(ctx, "TS.GET", "ccccc", "tstestcolumns", "sum", "2016:01:02 00:00:00",
+        "COLUMNS", "c"));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+
+    // An AOF rewrite rebuilds a series part by part
+    TSEntry entries[2 * TS_CHUNK_ENTRIES] = {{0}};
+    entries[1] = (TSEntry){ .count = 3, .avg = 2 };
+    entries[TS_CHUNK_ENTRIES + 1] = (TSEntry){ .count = 3, .avg = 5 };
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.RESTORE", "cclllcb", "tstestrestore", "SERIES", (long long)day,
+        1451606400LL, 2LL, fmt, "a\0b", (size_t)4));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.RESTORE", "ccb", "tstestrestore", "META", "host=a", (size_t)7));
+    RMCALL(r, RedisModule_Call(ctx, "TS.RESTORE", "ccb", "tstestrestore", "META", "host", (size_t)5));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.RESTORE", "ccccc", "tstestrestore", "OFFSET", "topic", "0", "7"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.RESTORE", "cccb", "tstestrestore", "CHUNK", "0",
+        (const char *)entries, sizeof(entries)));
+    RMCALL(r, RedisModule_Call(ctx, "TS.RESTORE", "cccb", "tstestrestore", "CHUNK", "0", (const char *)entries,
+        sizeof(TSEntry)));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.GET", "ccc", "tstestrestore", "sum", "2016:01:02 00:00:00"));
+    bucket = RedisModule_CallReplyArrayElement(r, 0);
+    RMUtil_Assert(strtod(RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(bucket, 0), NULL),
+        &eptr) == 6);
+    RMUtil_Assert(strtod(RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(bucket, 1), NULL),
+        &eptr) == 15);
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INFO", "c", "tstestrestore"));
+    RMUtil_Assert(strstr(RedisModule_CallReplyStringPtr(r, NULL), " Columns: a,b Meta: host=a"));
+    RMCALL(r, RedisModule_Call(ctx, "TS.INSERT", "cccccccc", "tstestrestore", "VALUES", "1", "1",
+        "OFFSET", "topic", "0", "7"));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+
+    RedisModule_FreeCallReply(r);
     return 0;
 }
 
@@ -153,6 +433,110 @@ int testTSAggData(RedisModuleCtx *ctx) {
     return 0;
 }
 
+int testTSDocGroup(RedisModuleCtx *ctx) {
+    const char *groupkey = "aggdatagroup";
+    const double sums[] = {13, 222, 30};
+    RedisModuleCallReply *r = NULL, *bucket;
+    cJSON *confJson = testConf(NULL), *data1 = dataJson(10.5, 10), *data2 = dataJson(2.5, 20);
+    char *eptr;
+
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "c", "aggdatagroup:userId1:accountId1"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "c", "aggdatagroup:userId2:accountId2"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "c", "aggdatagroup:userId2:accountId3"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "c", "aggdatagroup:userId3:accountId3"));
+    cJSON_AddTrueToObject(confJson, "group");
+    cJSON_AddItemToObject(confJson, "meta_fields", cJSON_CreateStringArray((const char *[]){"e=mail"}, 1));
+    RMCALL(r, RedisModule_Call(ctx, "ts.createdoc", "cc", groupkey, cJSON_Print_static(confJson)));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+    cJSON_ReplaceItemInObject(confJson, "meta_fields", cJSON_CreateStringArray((const char *[]){"email"}, 1));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "ts.createdoc", "cc", groupkey, cJSON_Print_static(confJson)));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "ts.insertdoc", "cc", groupkey, cJSON_Print_static(data1)));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "ts.insertdoc", "cc", groupkey, cJSON_Print_static(data2)));
+
+    // A single key holds every ts field as a column
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.GET", "cc", "aggdatagroup:userId1:accountId1", "sum"));
+    bucket = RedisModule_CallReplyArrayElement(r, 0);
+    RMUtil_Assert(RedisModule_CallReplyLength(bucket) == 3);
+    for (int i = 0; i < 3; i++)
+        RMUtil_Assert(strtod(RedisModule_CallReplyStringPtr(
+            RedisModule_CallReplyArrayElement(bucket, i), NULL), &eptr) == sums[i]);
+
+    // The group is found by its key fields
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.QUERYINDEX", "cc", groupkey, "userId=userId1"));
+    RMUtil_Assert(RedisModule_CallReplyLength(r) == 1);
+    RMUtil_Assert(!strcmp(RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(r, 0), NULL),
+        "aggdatagroup:userId1:accountId1"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.QUERYINDEX", "ccc", groupkey, "userId=userId1",
+        "accountId!=accountId1"));
+    RMUtil_Assert(RedisModule_CallReplyLength(r) == 0);
+
+    // Meta fields filter on the series itself
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.QUERYINDEX", "cc", groupkey, "email=user1@example.com"));
+    RMUtil_Assert(RedisModule_CallReplyLength(r) == 1);
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.QUERYINDEX", "cc", groupkey, "email!=user1@example.com"));
+    RMUtil_Assert(RedisModule_CallReplyLength(r) == 0);
+
+    // TS.MRANGE merges the buckets of every matching key, userId1 has none in the range
+    cJSON *entities[] = {
+        entityJson("userId2", "accountId2", "user1@example.com", 1, "2016:01:02 00:00:00"),
+        entityJson("userId2", "accountId3", "user1@example.com", 2, "2016:01:02 10:00:00"),
+        entityJson("userId3", "accountId3", "user3@example.com", 6, "2016:01:02 20:00:00"),
+        entityJson("userId2", "accountId2", "user1@example.com", 8, "2016:01:03 00:00:00"),
+    };
+    for (int i = 0; i < 4; i++) {
+        RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "ts.insertdoc", "cc", groupkey, cJSON_Print_static(entities[i])));
+        cJSON_Delete(entities[i]);
+    }
+    const char *start = "2016:01:02 00:00:00", *end = "2016:01:03 00:00:00";
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.MRANGE", "cccccccc", groupkey, "FIELD", "pagesVisited",
+        "AGG", "sum", "GROUPBY", "userId", start, end));
+    RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
+    RMUtil_Assert(mrangeEquals(r, "userId1", (double[]){0, 0}, 2));
+    RMUtil_Assert(mrangeEquals(r, "userId2", (double[]){3, 8}, 2));
+    RMUtil_Assert(mrangeEquals(r, "userId3", (double[]){6, 0}, 2));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.MRANGE", "cccccc", groupkey, "FIELD", "pagesVisited",
+        "AGG", "sum", start, end));
+    RMUtil_Assert(RedisModule_CallReplyLength(r) == 1);
+    RMUtil_Assert(mrangeEquals(r, "*", (double[]){9, 8}, 2));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.MRANGE", "cccccc", groupkey, "FIELD", "pagesVisited",
+        "AGG", "avg", start, end));
+    RMUtil_Assert(mrangeEquals(r, "*", (double[]){3, 8}, 2));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.MRANGE", "cccccc", groupkey, "FIELD", "pagesVisited",
+        "AGG", "count", start, end));
+    RMUtil_Assert(mrangeEquals(r, "*", (double[]){3, 1}, 2));
+
+    // Filters on key and meta fields narrow the keys, groups without keys are left out
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.MRANGE", "cccccccccc", groupkey, "FILTER", "userId=userId2",
+        "FIELD", "pagesVisited", "AGG", "sum", "GROUPBY", "accountId", start, end));
+    RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+    RMUtil_Assert(mrangeEquals(r, "accountId2", (double[]){1, 8}, 2));
+    RMUtil_Assert(mrangeEquals(r, "accountId3", (double[]){2, 0}, 2));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.MRANGE", "cccccccc", groupkey, "FILTER",
+        "email!=user1@example.com", "FIELD", "pagesVisited", "AGG", "sum", start, end));
+    RMUtil_Assert(mrangeEquals(r, "*", (double[]){6, 0}, 2));
+
+    // Plain inserts can't target a group
+    RMCALL(r, RedisModule_Call(ctx, "TS.INSERT", "cc", "aggdatagroup:userId1:accountId1", "1"));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+
+    // A query that finds the key gone drops it from every index set, and the values nothing else has
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "c", "aggdatagroup:userId1:accountId1"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.QUERYINDEX", "cc", groupkey, "userId=userId1"));
+    RMUtil_Assert(RedisModule_CallReplyLength(r) == 0);
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "EXISTS", "c", "aggdatagroup.idx:accountId=accountId1"));
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "SISMEMBER", "cc", "aggdatagroup.idx:accountId", "accountId1"));
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "SISMEMBER", "cc", "aggdatagroup.idx:userId", "userId1"));
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+
+    cJSON_Delete(data1);
+    cJSON_Delete(data2);
+    cJSON_Delete(confJson);
+    RedisModule_FreeCallReply(r);
+    return 0;
+}
+
 #define EQ(interval, t1, t2) \
         RMUtil_Assert( interval_timestamp(interval, t1, fmt) == interval_timestamp(interval, t2, fmt))
 
@@ -181,6 +565,12 @@ int testTimeInterval(RedisModuleCtx *ctx) {
     // Wrong format
     RMUtil_Assert(interval_timestamp(DAY, "2016-10-06 07:41:01", fmt) == 0)
 
+    // Another format, and one with directives that are left to strptime
+    RMUtil_Assert(interval_timestamp(DAY, "2016-11-05T07:41:01", "%Y-%m-%dT%H:%M:%S") ==
+                  interval_timestamp(DAY, "2016:11:05 06:42:02", fmt))
+    RMUtil_Assert(interval_timestamp(DAY, "05 Nov 2016 07:41", "%d %b %Y %H:%M") ==
+                  interval_timestamp(DAY, "2016:11:05 06:42:02", fmt))
+
     return 0;
 }
 
@@ -221,18 +611,374 @@ int testTimestampIdx(RedisModuleCtx *ctx) {
     return 0;
 }
 
-// Unit test entry point for the timeseries module
-int TestModule(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    RedisModule_AutoMemory(ctx);
+/* Do the outlier counts TS.INFO gives for key equal late and future? */
+int outliersEqual(RedisModuleCtx *ctx, const char *key, int late, int future) {
+    RedisModuleCallReply *r = RedisModule_Call(ctx, "TS.INFO", "c", key);
+    char expected[64];
+    int equal;
+
+    snprintf(expected, sizeof(expected), " Late: %d Future: %d", late, future);
+    if (!r || RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR)
+        equal = 0;
+    else if (!late && !future)
+        equal = !strstr(RedisModule_CallReplyStringPtr(r, NULL), " Late: ");
+    else
+        equal = strstr(RedisModule_CallReplyStringPtr(r, NULL), expected) != NULL;
+    if (r)
+        RedisModule_FreeCallReply(r);
+    return equal;
+}
+
+int testTSOutlierPolicies(RedisModuleCtx *ctx) {
+    RedisModuleCallReply *r = NULL;
+    char window[64];
+    time_t t = time(NULL) - 3600;
+    struct tm st;
+
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "c", "tstestoutliers"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.CREATE", "ccc", "tstestoutliers", "hour", "2016:01:01 00:00:00"));
+    ts_options.max_future = 3600;
+    ts_options.late_window = 3600;
+
+    ts_options.outlier_policy = ts_outlier_reject;
+    RMCALL(r, RedisModule_Call(ctx, "TS.INSERT", "ccc", "tstestoutliers", "1", "2016:01:02 00:00:00"));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+    RMCALL(r, RedisModule_Call(ctx, "TS.INSERT", "ccc", "tstestoutliers", "1", "2100:01:01 00:00:00"));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+    RMUtil_Assert(outliersEqual(ctx, "tstestoutliers", 1, 1));
+
+    // A late value is added to the first bucket of the window
+    ts_options.outlier_policy = ts_outlier_clamp;
+    strftime(window, sizeof(window), fmt, gmtime_r(&t, &st));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccc", "tstestoutliers", "1", "2016:01:02 00:00:00"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.GET", "ccc", "tstestoutliers", "count", window));
+    RMUtil_Assert(RedisModule_CallReplyInteger(RedisModule_CallReplyArrayElement(r, 0)) == 1);
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccc", "tstestoutliers", "1", "2100:01:01 00:00:00"));
+    RMUtil_Assert(outliersEqual(ctx, "tstestoutliers", 2, 2));
+
+    ts_options.outlier_policy = ts_outlier_drop;
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccc", "tstestoutliers", "1", "2016:01:02 00:00:00"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.GET", "ccc", "tstestoutliers", "count", "2016:01:02 00:00:00"));
+    RMUtil_Assert(RedisModule_CallReplyInteger(RedisModule_CallReplyArrayElement(r, 0)) == 0);
+    RMUtil_Assert(outliersEqual(ctx, "tstestoutliers", 3, 2));
+
+    // Imports are only held to the future horizon, and count nothing when they fail
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.IMPORT", "cccccc", "tstestoutliers", "BLOB",
+        "2016:01:03 00:00:00,5\n", "FORMAT", "csv"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.GET", "ccc", "tstestoutliers", "count", "2016:01:03 00:00:00"));
+    RMUtil_Assert(RedisModule_CallReplyInteger(RedisModule_CallReplyArrayElement(r, 0)) == 1);
+    RMCALL(r, RedisModule_Call(ctx, "TS.IMPORT", "cccccc", "tstestoutliers", "BLOB",
+        "2100:01:01 00:00:00,1\nnot a time,1\n", "FORMAT", "csv"));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+    RMUtil_Assert(outliersEqual(ctx, "tstestoutliers", 3, 2));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.IMPORT", "cccccc", "tstestoutliers", "BLOB",
+        "2100:01:01 00:00:00,1\n", "FORMAT", "csv"));
+    RMUtil_Assert(outliersEqual(ctx, "tstestoutliers", 3, 3));
+
+    // A document creating its key is held to the future horizon too
+    cJSON *conf = testConf(NULL), *doc = entityJson("userId1", "accountId1", "user1@example.com", 1,
+        "2100:01:01 00:00:00");
+    cJSON_AddTrueToObject(conf, "group");
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "c", "tstestoutdoc:userId1:accountId1"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.CREATEDOC", "cc", "tstestoutdoc", cJSON_Print_static(conf)));
+    ts_options.outlier_policy = ts_outlier_reject;
+    RMCALL(r, RedisModule_Call(ctx, "TS.INSERTDOC", "cc", "tstestoutdoc", cJSON_Print_static(doc)));
+    RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "EXISTS", "c", "tstestoutdoc:userId1:accountId1"));
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+
+    ts_options.outlier_policy = ts_outlier_clamp;
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERTDOC", "cc", "tstestoutdoc", cJSON_Print_static(doc)));
+    RMUtil_Assert(outliersEqual(ctx, "tstestoutdoc:userId1:accountId1", 0, 1));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INFO", "c", "tstestoutdoc:userId1:accountId1"));
+    RMUtil_Assert(!strstr(RedisModule_CallReplyStringPtr(r, NULL), "Start: 2100"));
+    RMUtil_Assert(strstr(RedisModule_CallReplyStringPtr(r, NULL), " len: 1 "));
+
+    ts_options.outlier_policy = ts_outlier_drop;
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "c", "tstestoutdoc:userId1:accountId1"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERTDOC", "cc", "tstestoutdoc", cJSON_Print_static(doc)));
+    RMUtil_Assert(outliersEqual(ctx, "tstestoutdoc:userId1:accountId1", 0, 1));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INFO", "c", "tstestoutdoc:userId1:accountId1"));
+    RMUtil_Assert(strstr(RedisModule_CallReplyStringPtr(r, NULL), " len: 0 "));
+    cJSON_Delete(conf);
+    cJSON_Delete(doc);
+
+    return 0;
+}
+
+int testTSOutliers(RedisModuleCtx *ctx) {
+    TSOptions options = ts_options;
+    int rc = testTSOutlierPolicies(ctx);
+    ts_options = options;
+    return rc;
+}
+
+/* The series of a key, to look at its chunks */
+struct TSObject *testSeries(RedisModuleCtx *ctx, const char *name) {
+    RedisModuleString *s = RedisModule_CreateString(ctx, name, strlen(name));
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, s, REDISMODULE_READ);
+    struct TSObject *tso = RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_MODULE ?
+        RedisModule_ModuleTypeGetValue(key) : NULL;
+    RedisModule_CloseKey(key);
+    RedisModule_FreeString(ctx, s);
+    return tso;
+}
+
+/* Is the sum of a single value series at timestamp expected? */
+int sumEquals(RedisModuleCtx *ctx, const char *key, const char *timestamp, double expected) {
+    RedisModuleCallReply *r = RedisModule_Call(ctx, "TS.GET", "ccc", key, "sum", timestamp);
+    int equal = r && RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ARRAY &&
+        strtod(RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(r, 0), NULL), NULL) == expected;
+    if (r)
+        RedisModule_FreeCallReply(r);
+    return equal;
+}
+
+int testTSColdChunks(RedisModuleCtx *ctx) {
+    RedisModuleCallReply *r = NULL;
+    struct TSObject *tso;
+    char start[64];
+    time_t t = time(NULL) - 300 * 86400;
+    struct tm st;
+    size_t len;
+
+    if (!ts_options.cold_dir)
+        ts_options.cold_dir = "/tmp";
+    RMUtil_Assert(ts_cold_open(ctx) == REDISMODULE_OK);
+    ts_options.cold_age = 365 * 86400;
+    ts_options.write_behind = 0;
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "cccc", "tstestcold", "tstestcold:recent", "tstestcold:dump",
+        "tstestcold:reuse"));
+
+    // A new chunk moves the chunks before it that are all past the cold age
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.CREATE", "ccc", "tstestcold", "day", "2016:01:01 00:00:00"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccc", "tstestcold", "1", "2016:01:02 00:00:00"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccc", "tstestcold", "2", "2016:10:27 00:00:00"));
+    tso = testSeries(ctx, "tstestcold");
+    RMUtil_Assert(tso->nchunks == 2 && tso->chunks[0]->cold_size && !tso->chunks[1]->cold_size);
+    TSEntry *cold = tso->chunks[0]->entry;
+    RMUtil_Assert(sumEquals(ctx, "tstestcold", "2016:01:02 00:00:00", 1));
+
+    strftime(start, sizeof(start), fmt, gmtime_r(&t, &st));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.CREATE", "ccc", "tstestcold:recent", "day", start));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccc", "tstestcold:recent", "1", start));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "cc", "tstestcold:recent", "1"));
+    tso = testSeries(ctx, "tstestcold:recent");
+    RMUtil_Assert(tso->nchunks == 2 && !tso->chunks[0]->cold_size);
+
+    // The RDB holds cold chunks like any other, and the load moves them back to the cold tier
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DUMP", "c", "tstestcold"));
+    const char *dump = RedisModule_CallReplyStringPtr(r, &len);
+    RedisModuleCallReply *restored = RedisModule_Call(ctx, "RESTORE", "ccb", "tstestcold:dump", "0", dump, len);
+    RMUtil_Assert(restored && RedisModule_CallReplyType(restored) != REDISMODULE_REPLY_ERROR);
+    RedisModule_FreeCallReply(restored);
+    RMUtil_Assert(sumEquals(ctx, "tstestcold:dump", "2016:01:02 00:00:00", 1));
+    RMUtil_Assert(sumEquals(ctx, "tstestcold:dump", "2016:10:27 00:00:00", 2));
+    tso = testSeries(ctx, "tstestcold:dump");
+    RMUtil_Assert(tso->chunks[0]->cold_size);
+
+    // A write copies the chunk back to memory, and the next cold chunk of its size takes the space
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccc", "tstestcold", "2", "2016:01:02 00:00:00"));
+    tso = testSeries(ctx, "tstestcold");
+    RMUtil_Assert(!tso->chunks[0]->cold_size && tso->chunks[0]->entry != cold);
+    RMUtil_Assert(sumEquals(ctx, "tstestcold", "2016:01:02 00:00:00", 3));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.CREATE", "ccc", "tstestcold:reuse", "day", "2016:01:01 00:00:00"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccc", "tstestcold:reuse", "5", "2016:01:02 00:00:00"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccc", "tstestcold:reuse", "5", "2016:10:27 00:00:00"));
+    tso = testSeries(ctx, "tstestcold:reuse");
+    RMUtil_Assert(tso->chunks[0]->cold_size && tso->chunks[0]->entry == cold);
+    RMUtil_Assert(sumEquals(ctx, "tstestcold:reuse", "2016:01:02 00:00:00", 5));
+    RMUtil_Assert(sumEquals(ctx, "tstestcold", "2016:01:02 00:00:00", 3));
+
+    RedisModule_FreeCallReply(r);
+    return 0;
+}
+
+int testTSWriteBehindStaging(RedisModuleCtx *ctx) {
+    RedisModuleCallReply *r = NULL;
+    struct TSObject *tso;
+    size_t len;
+
+    ts_options.write_behind = 4;
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "cc", "tstestwb", "tstestwb:dump"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.CREATE", "cccccc", "tstestwb", "day", "2016:01:01 00:00:00",
+        "COLUMNS", "a", "b"));
+
+    // A row to the bucket of the row before it is coalesced into its deltas
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccccc", "tstestwb", "VALUES", "1", "10",
+        "2016:01:02 00:00:00"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccccc", "tstestwb", "VALUES", "3", "30",
+        "2016:01:02 00:00:00"));
+    tso = testSeries(ctx, "tstestwb");
+    RMUtil_Assert(tso->npending == 2 && tso->pending[0].count == 2 && tso->pending[1].sum == 40);
+
+    // The deltas are folded once WRITE_BEHIND of them are staged
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccccc", "tstestwb", "VALUES", "1", "10",
+        "2016:01:03 00:00:00"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccccc", "tstestwb", "VALUES", "1", "10",
+        "2016:01:04 00:00:00"));
+    RMUtil_Assert(tso->npending == 2 && tso->chunks[0]->entry[1].count == 2 &&
+        tso->chunks[0]->entry[TS_CHUNK_ENTRIES + 2].avg == 10);
+
+    // Reads fold the deltas first
+    RMUtil_Assert(bucketEquals(ctx, "tstestwb", "sum", "2016:01:02 00:00:00", 4, 40));
+    RMUtil_Assert(tso->npending == 0);
+    RMUtil_Assert(bucketEquals(ctx, "tstestwb", "count", "2016:01:04 00:00:00", 1, 1));
+
+    // The RDB saves the deltas with the buckets
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERT", "ccccc", "tstestwb", "VALUES", "2", "20",
+        "2016:01:04 00:00:00"));
+    RMUtil_Assert(tso->npending == 2);
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DUMP", "c", "tstestwb"));
+    const char *dump = RedisModule_CallReplyStringPtr(r, &len);
+    RedisModuleCallReply *restored = RedisModule_Call(ctx, "RESTORE", "ccb", "tstestwb:dump", "0", dump, len);
+    RMUtil_Assert(restored && RedisModule_CallReplyType(restored) != REDISMODULE_REPLY_ERROR);
+    RedisModule_FreeCallReply(restored);
+    RMUtil_Assert(tso->npending == 0);
+    RMUtil_Assert(bucketEquals(ctx, "tstestwb:dump", "count", "2016:01:04 00:00:00", 2, 2));
+    RMUtil_Assert(bucketEquals(ctx, "tstestwb:dump", "sum", "2016:01:04 00:00:00", 3, 30));
+
+    // The staging buffer of a series is sized by the option it was created with
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "cc", "tstestwb", "tstestwb:dump"));
+    RedisModule_FreeCallReply(r);
+    return 0;
+}
 
+int testTSWriteBehind(RedisModuleCtx *ctx) {
+    TSOptions options = ts_options;
+    int rc = testTSWriteBehindStaging(ctx);
+    ts_options = options;
+    return rc;
+}
+
+int testTSCold(RedisModuleCtx *ctx) {
+    TSOptions options = ts_options;
+    int rc = testTSColdChunks(ctx);
+    ts_options = options;
+    return rc;
+}
+
+/* A document prepared on a worker, as TS.INSERTDOC does with THREADS */
+typedef struct TestDocJob {
+    TSDoc doc;
+    char *conf;
+    char *data;
+    const char *err;
+} TestDocJob;
+
+void *testDocPrepare(void *arg) {
+    TestDocJob *job = arg;
+    TSOffsetToken offset = { 0 };
+    job->err = ts_doc_prepare(&job->doc, "tstestasync", job->conf, job->data, &offset);
+    return NULL;
+}
+
+/* A range pinned on the main thread and packed on a worker, as a long TS.GET is */
+typedef struct TestGetJob {
+    TSRange range;
+    char buf[3 * TS_PACKED_ENTRY];
+} TestGetJob;
+
+void *testGetPack(void *arg) {
+    TestGetJob *job = arg;
+    const size_t cols[] = {0, 1, 2};
+    ts_range_pack(&job->range, cols, 3, job->buf);
+    return NULL;
+}
+
+/* Count and sum of a packed bucket */
+void testUnpack(const char *buf, uint32_t *count, double *sum) {
+    const unsigned char *p = (const unsigned char *)buf;
+    uint64_t bits = 0;
+    *count = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+    for (int i = 7; i >= 0; i--)
+        bits = bits << 8 | p[4 + i];
+    memcpy(sum, &bits, sizeof(*sum));
+}
+
+int testTSWorkers(RedisModuleCtx *ctx) {
+    RedisModuleCallReply *r = NULL;
+    cJSON *conf = testConf(NULL), *data = dataJson(10.5, 10);
+    TestDocJob docs[2];
+    TestGetJob get;
+    pthread_t threads[2];
+    uint32_t count;
+    double sum;
+
+    cJSON_AddTrueToObject(conf, "group");
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "DEL", "c", "tstestasync:userId1:accountId1"));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.CREATEDOC", "cc", "tstestasync", cJSON_Print_static(conf)));
+
+    // Documents are prepared in parallel off the main thread, and applied on it
+    for (int i = 0; i < 2; i++) {
+        docs[i] = (TestDocJob){ .conf = cJSON_PrintUnformatted(conf), .data = cJSON_PrintUnformatted(data) };
+        RMUtil_Assert(!pthread_create(&threads[i], NULL, testDocPrepare, &docs[i]));
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_join(threads[i], NULL);
+        if (!docs[i].err)
+            docs[i].err = ts_doc_apply(ctx, &docs[i].doc);
+        ts_doc_free(&docs[i].doc);
+        free(docs[i].conf);
+        free(docs[i].data);
+    }
+    RMUtil_Assert(!docs[0].err && !docs[1].err);
+
+    // The worker reads the buckets as they were pinned, while the main thread writes to them
+    struct TSObject *tso = testSeries(ctx, "tstestasync:userId1:accountId1");
+    ts_range_pin(tso, tso->len - 1, 1, &get.range);
+    RMUtil_Assert(!pthread_create(&threads[0], NULL, testGetPack, &get));
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.INSERTDOC", "cc", "tstestasync", cJSON_Print_static(data)));
+    pthread_join(threads[0], NULL);
+    ts_range_release(&get.range);
+    testUnpack(get.buf, &count, &sum);
+    RMUtil_Assert(count == 2 && sum == 21);
+    testUnpack(get.buf + 2 * TS_PACKED_ENTRY, &count, &sum);
+    RMUtil_Assert(count == 2 && sum == 20);
+    RMCALL_AssertNoErr(r, RedisModule_Call(ctx, "TS.GET", "cc", "tstestasync:userId1:accountId1", "count"));
+    RMUtil_Assert(replyValue(RedisModule_CallReplyArrayElement(RedisModule_CallReplyArrayElement(r, 0), 0)) == 3);
+
+    cJSON_Delete(conf);
+    cJSON_Delete(data);
+    RedisModule_FreeCallReply(r);
+    return 0;
+}
+
+int runTests(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RMUtil_Test(testTSApi);
 
+    RMUtil_Test(testTSColumns);
+
     RMUtil_Test(testTimeInterval);
 
     RMUtil_Test(testTimestampIdx);
 
     RMUtil_Test(testTSAggData);
 
+    RMUtil_Test(testTSDocGroup);
+
+    RMUtil_Test(testTSOutliers);
+
+    RMUtil_Test(testTSCold);
+
+    RMUtil_Test(testTSWriteBehind);
+
+    RMUtil_Test(testTSWorkers);
+
+    return REDISMODULE_OK;
+}
+
+// Unit test entry point for the timeseries module
+int TestModule(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    // Commands called through RedisModule_Call can't be blocked, keep them on the main thread
+    ts_async_enabled = 0;
+    int rc = runTests(ctx, argv, argc);
+    ts_async_enabled = 1;
+    if (rc != REDISMODULE_OK)
+        return rc;
+
     RedisModule_ReplyWithSimpleString(ctx, "PASS");
     return REDISMODULE_OK;
 }
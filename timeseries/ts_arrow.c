@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include "ts_arrow.h"
+
+/* Arrow metadata is a flatbuffer. The builder here lays it out front to back: every table is written before the
+ * tables, vectors and strings it refers to, and the forward offsets to them are patched in once they're written. */
+typedef struct TSFlat {
+    char *buf;
+    size_t len;
+    size_t cap;
+} TSFlat;
+
+/* A table field: 'size' bytes of 'value', or 0 if absent. Offsets are 4 bytes, set later with fb_patch. */
+typedef struct TSFlatField {
+    size_t size;
+    uint64_t value;
+} TSFlatField;
+
+// Message.fbs, Schema.fbs
+#define ARROW_METADATA_V5 4
+#define ARROW_HEADER_SCHEMA 1
+#define ARROW_HEADER_RECORD_BATCH 3
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FLOAT 3
+#define ARROW_TYPE_TIMESTAMP 10
+#define ARROW_PRECISION_DOUBLE 2
+#define ARROW_UNIT_SECOND 0
+#define ARROW_CONTINUATION 0xffffffff
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define ARROW_ENDIANNESS 1
+#else
+#define ARROW_ENDIANNESS 0
+#endif
+
+static size_t fb_reserve(TSFlat *b, size_t n) {
+    if (b->len + n > b->cap) {
+        while (b->len + n > b->cap)
+            b->cap = b->cap ? b->cap * 2 : 1024;
+        b->buf = RedisModule_Realloc(b->buf, b->cap);
+    }
+    size_t pos = b->len;
+    memset(b->buf + pos, 0, n);
+    b->len += n;
+    return pos;
+}
+
+static void fb_align(TSFlat *b, size_t align) {
+    fb_reserve(b, (align - b->len % align) % align);
+}
+
+static void fb_le(TSFlat *b, size_t pos, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; i++, value >>= 8)
+        b->buf[pos + i] = (char)(value & 0xff);
+}
+
+static void fb_scalar(TSFlat *b, uint64_t value, size_t size) {
+    fb_align(b, size);
+    fb_le(b, fb_reserve(b, size), value, size);
+}
+
+/* Point the offset at pos to target, which comes after it */
+static void fb_patch(TSFlat *b, size_t pos, size_t target) {
+    fb_le(b, pos, target - pos, 4);
+}
+
+/* Write a table preceded by its vtable. pos[i] is set to the position of field i, for fb_patch. */
+static size_t fb_table(TSFlat *b, const TSFlatField *f, int n, size_t *pos) {
+    size_t at[n], size = 4;
+
+    for (int i = 0; i < n; i++) {
+        if (!f[i].size) {
+            at[i] = 0;
+            continue;
+        }
+        size = (size + f[i].size - 1) / f[i].size * f[i].size;
+        at[i] = size;
+        size += f[i].size;
+    }
+
+    fb_align(b, 2);
+    size_t vtable = b->len;
+    fb_scalar(b, 4 + 2 * n, 2);
+    fb_scalar(b, size, 2);
+    for (int i = 0; i < n; i++)
+        fb_scalar(b, at[i], 2);
+
+    fb_align(b, 8);
+    size_t table = fb_reserve(b, size);
+    fb_le(b, table, table - vtable, 4);
+    for (int i = 0; i < n; i++) {
+        if (f[i].size)
+            fb_le(b, table + at[i], f[i].value, f[i].size);
+        if (pos)
+            pos[i] = table + at[i];
+    }
+    return table;
+}
+
+/* Write the length of a vector of n elements of 'size' bytes, with the elements aligned to 8 bytes.
+ * The elements start 4 bytes after the returned position. */
+static size_t fb_vector(TSFlat *b, size_t n, size_t size) {
+    fb_align(b, 8);
+    fb_reserve(b, 4);
+    size_t pos = fb_reserve(b, 4 + n * size);
+    fb_le(b, pos, n, 4);
+    return pos;
+}
+
+static size_t fb_string(TSFlat *b, const char *s) {
+    size_t len = strlen(s);
+
+    fb_align(b, 4);
+    size_t pos = fb_reserve(b, 4 + len + 1);
+    fb_le(b, pos, len, 4);
+    memcpy(b->buf + pos + 4, s, len);
+    return pos;
+}
+
+/* Write a Message table with the given header type, returning the position of its header offset */
+static size_t arrow_message(TSFlat *b, int type, uint64_t body_len) {
+    TSFlatField f[] = {{2, ARROW_METADATA_V5}, {1, type}, {4, 0}, {8, body_len}};
+    size_t pos[4];
+
+    size_t root = fb_reserve(b, 4);
+    fb_patch(b, root, fb_table(b, f, 4, pos));
+    return pos[2];
+}
+
+/* Write a Field of the given type, referred to by the offset at ref */
+static void arrow_field(TSFlat *b, size_t ref, const char *name, int type) {
+    TSFlatField f[] = {{4, 0}, {1, 0}, {1, type}, {4, 0}, {0, 0}, {4, 0}};
+    size_t pos[6];
+
+    fb_patch(b, ref, fb_table(b, f, 6, pos));
+    fb_patch(b, pos[0], fb_string(b, name));
+
+    size_t tpos[2];
+    if (type == ARROW_TYPE_TIMESTAMP) {
+        TSFlatField t[] = {{2, ARROW_UNIT_SECOND}, {4, 0}};
+        fb_patch(b, pos[3], fb_table(b, t, 2, tpos));
+        fb_patch(b, tpos[1], fb_string(b, "UTC"));
+    } else if (type == ARROW_TYPE_INT) {
+        TSFlatField t[] = {{4, 32}, {1, 0}};
+        fb_patch(b, pos[3], fb_table(b, t, 2, NULL));
+    } else {
+        TSFlatField t[] = {{2, ARROW_PRECISION_DOUBLE}};
+        fb_patch(b, pos[3], fb_table(b, t, 1, NULL));
+    }
+
+    // Readers expect a children vector even on primitive fields
+    fb_patch(b, pos[5], fb_vector(b, 0, 4));
+}
+
+/* Frame the metadata flatbuffer m as an encapsulated message on out */
+static void arrow_frame(TSFlat *out, TSFlat *m) {
+    fb_align(m, 8);
+    fb_le(out, fb_reserve(out, 4), ARROW_CONTINUATION, 4);
+    fb_le(out, fb_reserve(out, 4), m->len, 4);
+    size_t pos = fb_reserve(out, m->len);
+    memcpy(out->buf + pos, m->buf, m->len);
+    m->len = 0;
+}
+
+// Bytes of a buffer of the body, which are padded to 8 bytes
+#define ARROW_PAD(n) (((n) + 7) & ~(size_t)7)
+
+char *ts_arrow_stream(struct TSObject *o, TSRange *r, size_t from, size_t *len) {
+    TSFlat out = {NULL, 0, 0}, m = {NULL, 0, 0};
+    size_t nfields = 1 + 3 * o->ncols, pos[4];
+    char name[TS_MAX_KEY_LEN];
+    static const char *stats[] = {"count", "sum", "avg"};
+
+    // Schema
+    TSFlatField schema[] = {{2, ARROW_ENDIANNESS}, {4, 0}};
+    size_t header = arrow_message(&m, ARROW_HEADER_SCHEMA, 0);
+    fb_patch(&m, header, fb_table(&m, schema, 2, pos));
+    size_t fields = fb_vector(&m, nfields, 4);
+    fb_patch(&m, pos[1], fields);
+    arrow_field(&m, fields + 4, "timestamp", ARROW_TYPE_TIMESTAMP);
+    for (size_t i = 1; i < nfields; i++) {
+        size_t col = (i - 1) / 3;
+        const char *stat = stats[(i - 1) % 3];
+        if (o->columns)
+            snprintf(name, sizeof(name), "%s.%s", ts_column_name(o, col), stat);
+        else
+            snprintf(name, sizeof(name), "%s", stat);
+        arrow_field(&m, fields + 4 + 4 * i, name, (i - 1) % 3 ? ARROW_TYPE_FLOAT : ARROW_TYPE_INT);
+    }
+    arrow_frame(&out, &m);
+
+    // Record batch, a validity buffer (empty, no nulls) and a values buffer per field
+    size_t body_len = ARROW_PAD(r->len * 8) + o->ncols * (ARROW_PAD(r->len * 4) + 2 * ARROW_PAD(r->len * 8));
+    TSFlatField batch[] = {{8, r->len}, {4, 0}, {4, 0}};
+    header = arrow_message(&m, ARROW_HEADER_RECORD_BATCH, body_len);
+    fb_patch(&m, header, fb_table(&m, batch, 3, pos));
+
+    size_t nodes = fb_vector(&m, nfields, 16);
+    fb_patch(&m, pos[1], nodes);
+    for (size_t i = 0; i < nfields; i++)
+        fb_le(&m, nodes + 4 + 16 * i, r->len, 8);
+
+    size_t buffers = fb_vector(&m, 2 * nfields, 16), offset = 0;
+    fb_patch(&m, pos[2], buffers);
+    for (size_t i = 0; i < nfields; i++) {
+        size_t size = r->len * (i && (i - 1) % 3 == 0 ? 4 : 8);
+        fb_le(&m, buffers + 4 + 32 * i, offset, 8);
+        fb_le(&m, buffers + 4 + 32 * i + 16, offset, 8);
+        fb_le(&m, buffers + 4 + 32 * i + 24, size, 8);
+        offset += ARROW_PAD(size);
+    }
+    arrow_frame(&out, &m);
+    RedisModule_Free(m.buf);
+
+    // Body, straight from the buckets
+    size_t at = fb_reserve(&out, body_len);
+    char *body = out.buf + at;
+    int64_t *timestamps = (int64_t *)body;
+    for (size_t i = 0; i < r->len; i++)
+        timestamps[i] = o->init_timestamp + (int64_t)(from + i) * o->interval;
+    body += ARROW_PAD(r->len * 8);
+
+    for (size_t col = 0; col < o->ncols; col++) {
+        uint32_t *count = (uint32_t *)body;
+        double *sum = (double *)(body + ARROW_PAD(r->len * 4));
+        double *avg = sum + ARROW_PAD(r->len * 8) / 8;
+        for (size_t i = 0; i < r->len; i++) {
+            TSEntry *e = ts_range_entry(r, i, col);
+            count[i] = e->count;
+            sum[i] = e->avg * e->count;
+            avg[i] = e->avg;
+        }
+        body += ARROW_PAD(r->len * 4) + 2 * ARROW_PAD(r->len * 8);
+    }
+
+    // End of stream
+    fb_le(&out, fb_reserve(&out, 4), ARROW_CONTINUATION, 4);
+    fb_reserve(&out, 4);
+
+    *len = out.len;
+    return out.buf;
+}
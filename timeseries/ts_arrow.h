@@ -0,0 +1,13 @@
+#ifndef _TS_ARROW_H_
+#define _TS_ARROW_H_
+
+#include "timeseries.h"
+#include "ts_entry.h"
+
+/* Encode the buckets of r, starting at bucket 'from' of o, as an Arrow IPC stream: a schema message, one record
+ * batch and the end of stream marker. The batch has a timestamp column (seconds, UTC) followed by count, sum and
+ * avg columns for every column of o. Column buffers are in host byte order, as declared by the schema.
+ * Returns a buffer of *len bytes, to free with RedisModule_Free. */
+char *ts_arrow_stream(struct TSObject *o, TSRange *r, size_t from, size_t *len);
+
+#endif
@@ -0,0 +1,185 @@
+/* Micro benchmarks of the insert and read hot paths, without redis. Build and run with `make bench`.
+ * The RedisModule allocator is stubbed with malloc and counted, so every benchmark reports ns and allocations
+ * per operation. */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ts_utils.h"
+
+static size_t allocs;
+
+static void *bench_alloc(size_t bytes) {
+    allocs++;
+    return malloc(bytes);
+}
+
+static void *bench_calloc(size_t nmemb, size_t size) {
+    allocs++;
+    return calloc(nmemb, size);
+}
+
+static void *bench_realloc(void *ptr, size_t bytes) {
+    allocs++;
+    return realloc(ptr, bytes);
+}
+
+static void bench_free(void *ptr) {
+    free(ptr);
+}
+
+static char *bench_strdup(const char *str) {
+    allocs++;
+    return strdup(str);
+}
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Time n calls of op(i, arg) */
+static void bench(const char *name, size_t n, void (*op)(size_t, void *), void *arg) {
+    size_t start_allocs = allocs;
+    double start = bench_now();
+
+    for (size_t i = 0; i < n; i++)
+        op(i, arg);
+
+    double ns = bench_now() - start;
+    printf("%-44s %10.1f ns/op %8.3f allocs/op\n", name, ns / n, (double)(allocs - start_allocs) / n);
+}
+
+static volatile time_t sink;
+static volatile double sink_value;
+
+// Values per bucket of the insert benchmarks
+#define BENCH_PER_BUCKET 4
+
+static void bench_add_item(size_t i, void *arg) {
+    struct TSObject *o = arg;
+    TSAddItem(o, i, o->init_timestamp + i / BENCH_PER_BUCKET);
+}
+
+static void bench_add_row(size_t i, void *arg) {
+    struct TSObject *o = arg;
+    double values[4] = {i, i, i, i};
+    TSAddRow(o, values, o->init_timestamp + i / BENCH_PER_BUCKET);
+}
+
+static const char *timestamps[] = {
+    "2016:11:05 06:40:01", "2016:11:05 07:41:02", "2016:12:31 23:59:59", "2017:01:01 00:00:00",
+};
+
+static void bench_interval_timestamp(size_t i, void *arg) {
+    sink = interval_timestamp(HOUR, timestamps[i % 4], DEFAULT_TIMEFMT);
+}
+
+static void bench_interval2timestamp(size_t i, void *arg) {
+    sink = interval2timestamp(hour, timestamps[i % 4], arg);
+}
+
+static void bench_interval2timestamp_iso(size_t i, void *arg) {
+    static const char *iso[] = {"2016-11-05T06:40:01", "2016-12-31T23:59:59"};
+    sink = interval2timestamp(hour, iso[i % 2], arg);
+}
+
+static void bench_interval_now(size_t i, void *arg) {
+    sink = interval2timestamp(hour, NULL, NULL);
+}
+
+static void bench_idx_timestamp(size_t i, void *arg) {
+    sink = idx_timestamp(1478304000, 1478304000 + i * 60, hour);
+}
+
+static void bench_doc_key_prefix(size_t i, void *arg) {
+    cJSON **doc = arg;
+    char buf[TS_MAX_KEY_LEN];
+    sink = doc_key_prefix(buf, sizeof(buf), "tsdoctest", doc[0], doc[1]);
+}
+
+// Buckets read by the range benchmarks
+#define BENCH_RANGE 10000
+
+static void bench_range_merge(size_t i, void *arg) {
+    struct TSObject *o = arg;
+    static double sum[BENCH_RANGE], count[BENCH_RANGE];
+    TSRange r;
+
+    ts_range_pin(o, (i * 997) % (o->len - BENCH_RANGE), BENCH_RANGE, &r);
+    ts_range_merge(&r, 0, sum, count);
+    ts_range_release(&r);
+    sink_value = sum[i % BENCH_RANGE];
+}
+
+static void bench_range_pack(size_t i, void *arg) {
+    struct TSObject *o = arg;
+    static char buf[BENCH_RANGE * TS_PACKED_ENTRY];
+    size_t col = 0;
+    TSRange r;
+
+    ts_range_pin(o, (i * 997) % (o->len - BENCH_RANGE), BENCH_RANGE, &r);
+    sink = ts_range_pack(&r, &col, 1, buf);
+    ts_range_release(&r);
+}
+
+static struct TSObject *bench_series(Interval interval, size_t ncols) {
+    static const char *columns[] = {"a", "b", "c", "d"};
+    struct TSObject *o = createTSObject();
+
+    o->interval = interval;
+    o->init_timestamp = 1451606400;
+    o->timefmt = ts_timefmt_default();
+    if (ncols > 1)
+        ts_set_columns(o, ncols, columns);
+    return o;
+}
+
+int main(int argc, char **argv) {
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+    RedisModule_Alloc = bench_alloc;
+    RedisModule_Calloc = bench_calloc;
+    RedisModule_Realloc = bench_realloc;
+    RedisModule_Free = bench_free;
+    RedisModule_Strdup = bench_strdup;
+
+    struct TSObject *o = bench_series(second, 1);
+    bench("TSAddItem", n, bench_add_item, o);
+    struct TSObject *row = bench_series(second, 4);
+    bench("TSAddRow (4 columns)", n, bench_add_row, row);
+
+    TSTimeFmt iso;
+    ts_timefmt_compile(&iso, "%Y-%m-%dT%H:%M:%S");
+    bench("interval_timestamp", n, bench_interval_timestamp, NULL);
+    bench("interval2timestamp", n, bench_interval2timestamp, (void *)ts_timefmt_default());
+    bench("interval2timestamp (%Y-%m-%dT%H:%M:%S)", n, bench_interval2timestamp_iso, &iso);
+    bench("interval2timestamp (now)", n, bench_interval_now, NULL);
+    bench("idx_timestamp", n, bench_idx_timestamp, NULL);
+
+    cJSON *doc[2] = {
+        cJSON_Parse("{\"key_fields\": [\"userId\", \"deviceId\"], \"ts_fields\": [\"pagesVisited\"],"
+                    " \"interval\": \"hour\"}"),
+        cJSON_Parse("{\"userId\": \"user1\", \"deviceId\": \"deviceA\", \"pagesVisited\": 1}"),
+    };
+    bench("doc_key_prefix", n, bench_doc_key_prefix, doc);
+
+    // Ranges of the TSAddItem series, a fraction of the operations as each reads BENCH_RANGE buckets. A small n
+    // leaves the series too short, it's grown past BENCH_RANGE buckets first.
+    for (size_t i = n; i <= BENCH_RANGE * BENCH_PER_BUCKET; i++)
+        bench_add_item(i, o);
+    ts_flush(o);
+    size_t ranges = n / 1000 ? n / 1000 : 1;
+    char name[64];
+    snprintf(name, sizeof(name), "ts_range_merge (%d buckets)", BENCH_RANGE);
+    bench(name, ranges, bench_range_merge, o);
+    snprintf(name, sizeof(name), "ts_range_pack (%d buckets)", BENCH_RANGE);
+    bench(name, ranges, bench_range_pack, o);
+
+    cJSON_Delete(doc[0]);
+    cJSON_Delete(doc[1]);
+    TSReleaseObject(o);
+    TSReleaseObject(row);
+    return 0;
+}
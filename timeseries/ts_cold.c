@@ -0,0 +1,192 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "ts_cold.h"
+#include "ts_options.h"
+
+// Bytes of a chunk per column, chunk sizes are a multiple of it
+#define TS_COLD_UNIT (sizeof(TSEntry) * TS_CHUNK_ENTRIES)
+
+/* Freed space of chunks of one size */
+typedef struct TSColdFree {
+    TSEntry **entries;
+    size_t len;
+    size_t size;
+} TSColdFree;
+
+/* Space freed while a forked child may still read it */
+typedef struct TSColdPending {
+    TSEntry *entry;
+    size_t size;
+} TSColdPending;
+
+static int cold_fd = -1;
+static char **cold_segments;    // Mapping of every segment, segment i is at file offset i * TS_COLD_SEGMENT
+static size_t cold_nsegments;
+static size_t cold_used;        // Bytes used in the last segment
+static pid_t cold_pid;          // Process that opened the file, forked children share it and never write it
+// Freed space by chunk size in TS_COLD_UNIT. Chunks are freed on whatever thread releases them last.
+static TSColdFree cold_free[TS_MAX_COLUMNS + 1];
+static pthread_mutex_t cold_lock = PTHREAD_MUTEX_INITIALIZER;
+/* The file is a shared mapping, so a BGSAVE child sees what the parent writes to it. Space freed while a child
+ * lives is held back until every child exited, or a child would save another chunk's buckets. Each fork leaves the
+ * parent the read end of a pipe whose write end only the child holds: it hangs up once the child exits. */
+static int *cold_children;
+static size_t cold_nchildren;
+static int cold_fork_pipe[2] = {-1, -1};
+static int cold_fork_lost;      // A fork couldn't be tracked, held back space is never reused
+static TSColdPending *cold_pending;
+static size_t cold_npending, cold_pending_size;
+
+/* Fork handlers. The lock is held across the fork, so the child never inherits it locked by another thread. */
+static void ts_cold_prepare(void) {
+    pthread_mutex_lock(&cold_lock);
+    if (pipe(cold_fork_pipe) < 0)
+        cold_fork_pipe[0] = cold_fork_pipe[1] = -1;
+}
+
+static void ts_cold_parent(void) {
+    if (cold_fork_pipe[0] < 0) {
+        cold_fork_lost = 1;
+    } else {
+        close(cold_fork_pipe[1]);
+        cold_children = RedisModule_Realloc(cold_children, sizeof(int) * (cold_nchildren + 1));
+        cold_children[cold_nchildren++] = cold_fork_pipe[0];
+    }
+    pthread_mutex_unlock(&cold_lock);
+}
+
+static void ts_cold_child(void) {
+    if (cold_fork_pipe[0] >= 0)
+        close(cold_fork_pipe[0]);
+    pthread_mutex_unlock(&cold_lock);
+}
+
+int ts_cold_open(RedisModuleCtx *ctx) {
+    char path[PATH_MAX];
+
+    if (cold_fd >= 0)
+        return REDISMODULE_OK;
+    snprintf(path, sizeof(path), "%s/timeseries.%d.cold", ts_options.cold_dir, (int)getpid());
+    if ((cold_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0) {
+        RedisModule_Log(ctx, "warning", "Can't open cold file %s: %s", path, strerror(errno));
+        return REDISMODULE_ERR;
+    }
+    unlink(path);
+    cold_pid = getpid();
+    pthread_atfork(ts_cold_prepare, ts_cold_parent, ts_cold_child);
+    return REDISMODULE_OK;
+}
+
+static TSColdFree *ts_cold_free_list(size_t size) {
+    size_t units = size / TS_COLD_UNIT;
+    return size % TS_COLD_UNIT || units > TS_MAX_COLUMNS ? NULL : &cold_free[units];
+}
+
+/* File offset of mapped cold entries */
+static off_t ts_cold_offset(const TSEntry *entry) {
+    for (size_t i = 0; i < cold_nsegments; i++)
+        if ((const char *)entry >= cold_segments[i] && (const char *)entry < cold_segments[i] + TS_COLD_SEGMENT)
+            return (off_t)i * TS_COLD_SEGMENT + ((const char *)entry - cold_segments[i]);
+    return -1;
+}
+
+static void ts_cold_push(TSColdFree *list, TSEntry *entry) {
+    if (list->len == list->size) {
+        list->size = list->size ? list->size * 2 : 64;
+        list->entries = RedisModule_Realloc(list->entries, sizeof(TSEntry *) * list->size);
+    }
+    list->entries[list->len++] = entry;
+}
+
+/* Forget the children that exited. Returns whether any child may still read the file. Called with cold_lock held. */
+static int ts_cold_children(void) {
+    size_t n = 0;
+
+    for (size_t i = 0; i < cold_nchildren; i++) {
+        struct pollfd p = { .fd = cold_children[i], .events = 0 };
+        if (poll(&p, 1, 0) == 1 && (p.revents & POLLHUP))
+            close(cold_children[i]);
+        else
+            cold_children[n++] = cold_children[i];
+    }
+    cold_nchildren = n;
+    return n || cold_fork_lost;
+}
+
+/* Space for size bytes, freed space first. Called with cold_lock held. */
+static TSEntry *ts_cold_alloc(size_t size) {
+    if (cold_npending && !ts_cold_children()) {
+        for (size_t i = 0; i < cold_npending; i++)
+            ts_cold_push(ts_cold_free_list(cold_pending[i].size), cold_pending[i].entry);
+        cold_npending = 0;
+    }
+
+    TSColdFree *list = ts_cold_free_list(size);
+    if (list && list->len)
+        return list->entries[--list->len];
+
+    if (!cold_nsegments || cold_used + size > TS_COLD_SEGMENT) {
+        off_t offset = (off_t)cold_nsegments * TS_COLD_SEGMENT;
+        if (ftruncate(cold_fd, offset + TS_COLD_SEGMENT) < 0)
+            return NULL;
+        char *segment = mmap(NULL, TS_COLD_SEGMENT, PROT_READ, MAP_SHARED, cold_fd, offset);
+        if (segment == MAP_FAILED)
+            return NULL;
+        // Full segments stay mapped, the chunks in them are still read
+        cold_segments = RedisModule_Realloc(cold_segments, sizeof(char *) * (cold_nsegments + 1));
+        cold_segments[cold_nsegments++] = segment;
+        cold_used = 0;
+    }
+
+    TSEntry *cold = (TSEntry *)(cold_segments[cold_nsegments - 1] + cold_used);
+    cold_used += size;
+    return cold;
+}
+
+TSEntry *ts_cold_store(const TSEntry *entry, size_t size) {
+    if (cold_fd < 0 || size > TS_COLD_SEGMENT || getpid() != cold_pid)
+        return NULL;
+
+    pthread_mutex_lock(&cold_lock);
+    TSEntry *cold = ts_cold_alloc(size);
+    pthread_mutex_unlock(&cold_lock);
+    if (!cold)
+        return NULL;
+
+    off_t offset = ts_cold_offset(cold);
+    for (size_t done = 0; done < size;) {
+        ssize_t n = pwrite(cold_fd, (const char *)entry + done, size - done, offset + done);
+        if (n <= 0) {
+            ts_cold_free(cold, size);
+            return NULL;
+        }
+        done += n;
+    }
+    return cold;
+}
+
+void ts_cold_free(TSEntry *entry, size_t size) {
+    // The space is the parent's to reuse, a child only drops its reference
+    if (getpid() != cold_pid)
+        return;
+
+    pthread_mutex_lock(&cold_lock);
+    TSColdFree *list = ts_cold_free_list(size);
+    if (list && (cold_nchildren || cold_fork_lost)) {
+        if (cold_npending == cold_pending_size) {
+            cold_pending_size = cold_pending_size ? cold_pending_size * 2 : 64;
+            cold_pending = RedisModule_Realloc(cold_pending, sizeof(TSColdPending) * cold_pending_size);
+        }
+        cold_pending[cold_npending++] = (TSColdPending){ .entry = entry, .size = size };
+    } else if (list) {
+        ts_cold_push(list, entry);
+    }
+    pthread_mutex_unlock(&cold_lock);
+}
@@ -0,0 +1,29 @@
+#ifndef _TS_COLD_H_
+#define _TS_COLD_H_
+
+#include "timeseries.h"
+#include "ts_entry.h"
+
+/* Cold tier: chunks whose buckets are all older than COLD_AGE seconds are moved to a file in COLD_DIR, and read
+ * through a shared read only mapping of it. The file only lives as long as the process, it's unlinked once opened:
+ * the RDB embeds cold chunks like any other.
+ * The space of a cold chunk is freed once it's no longer referenced, when it's copied back to memory for a write or
+ * its series is deleted, and reused by the next chunk of the same size once no forked child (BGSAVE) that could
+ * still read it is alive. The file never shrinks: it keeps the size of the most cold data held at once, and space
+ * freed by chunks of a column count that isn't stored again stays unused until a restart. */
+
+// The file is mapped a segment at a time, to keep the number of mappings low
+#define TS_COLD_SEGMENT (64 << 20)
+
+/* Open the cold file in COLD_DIR, unless it's open already. Must be called on the main thread. */
+int ts_cold_open(RedisModuleCtx *ctx);
+
+/* Append size bytes of entries to the cold file. Returns their mapped copy, or NULL if the tier is off, the file
+ * can't grow or this is a forked child. Must be called on the main thread. */
+TSEntry *ts_cold_store(const TSEntry *entry, size_t size);
+
+/* Free the space of size bytes of entries returned by ts_cold_store, for reuse once no forked child can read it.
+ * Can be called from any thread, does nothing in a forked child. */
+void ts_cold_free(TSEntry *entry, size_t size);
+
+#endif
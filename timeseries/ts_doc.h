@@ -0,0 +1,48 @@
+#ifndef _TS_DOC_H_
+#define _TS_DOC_H_
+
+#include "timeseries.h"
+#include "ts_time.h"
+
+/* A source partition offset sent with an insert, for exactly once ingestion */
+typedef struct TSOffsetToken {
+    const char *source;     // NULL if the insert has no offset
+    long long partition;
+    long long offset;
+} TSOffsetToken;
+
+/* A document parsed and validated against its configuration, with the aggregation keys and values
+ * extracted. Preparing it doesn't touch the keyspace, so it can be done off the main thread. */
+typedef struct TSDoc {
+    char *name;
+    int n;                  // Number of ts fields
+    int nkeys;              // n, or 1 for a document group
+    size_t prefix_len;      // Length of the entity prefix all the keys start with
+    char **labels;          // "label=value" of every key field, for the label index
+    int nlabels;
+    char **meta;            // "label=value" of every meta field, stored on new series
+    int nmeta;
+    Interval interval;
+    time_t timestamp;       // Document time on the configured interval
+    char *timestamp_str;    // Document time as sent, NULL for now
+    char *timefmt_str;      // "timeformat" of the configuration, for the series the document creates
+    TSTimeFmt timefmt;      // timefmt_str compiled
+    char **keys;            // Aggregation keys, stored back to back in a single allocation
+    size_t *key_lens;
+    const char **columns;   // Column names of a document group, NULL otherwise
+    double *values;
+    TSOffsetToken offset;   // Source offset of the document, its source is owned by the doc
+} TSDoc;
+
+void ts_doc_free(TSDoc *doc);
+
+/* Parse and validate a document against the configuration of 'name'.
+ * Returns an error message, or NULL if doc is ready to be applied. */
+const char *ts_doc_prepare(TSDoc *doc, const char *name, const char *conf_str, const char *data_str,
+                           TSOffsetToken *offset);
+
+/* Add a prepared document to its aggregation keys, creating the missing ones. Must be called with the redis lock.
+ * Returns an error message, or NULL if the document was added. */
+const char *ts_doc_apply(RedisModuleCtx *ctx, TSDoc *doc);
+
+#endif
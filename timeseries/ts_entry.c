@@ -1,45 +1,573 @@
 #include "ts_entry.h"
+#include "ts_options.h"
+#include "ts_cold.h"
+#include "ts_utils.h"
+
+#define TS_ENCVER 7
+
+// Shared by every range that was never written. Its own reference keeps it from being freed.
+static struct {
+    TSChunk chunk;
+    TSEntry entry[TS_CHUNK_ENTRIES * TS_MAX_COLUMNS];
+} empty = { .chunk = { .refcount = 1, .entry = empty.entry } };
 
 struct TSObject *createTSObject(void) {
     struct TSObject *o;
-    o = RedisModule_Alloc(sizeof(*o));
-    o->entry = NULL;
-    o->len = 0;
+    o = RedisModule_Calloc(1, sizeof(*o));
+    o->ncols = 1;
     return o;
 }
 
+void ts_set_columns(struct TSObject *o, size_t ncols, const char **columns) {
+    o->ncols = ncols;
+    o->columns = RedisModule_Alloc(sizeof(TSAtom) * ncols);
+    for (size_t i = 0; i < ncols; i++)
+        o->columns[i] = ts_intern(columns[i], strlen(columns[i]));
+}
+
+int ts_column(struct TSObject *o, const char *name) {
+    TSAtom id = ts_intern_find(name, strlen(name));
+    for (size_t i = 0; id != TS_ATOM_NONE && o->columns && i < o->ncols; i++)
+        if (o->columns[i] == id)
+            return i;
+    return -1;
+}
+
+static void ts_release_meta(struct TSObject *o) {
+    for (size_t i = 0; i < o->nmeta * 2; i++)
+        ts_intern_release(o->meta[i]);
+    RedisModule_Free(o->meta);
+    o->meta = NULL;
+    o->nmeta = 0;
+}
+
+void ts_set_meta(struct TSObject *o, char **meta, int n) {
+    ts_release_meta(o);
+    if (!n)
+        return;
+
+    o->meta = RedisModule_Alloc(sizeof(TSAtom) * n * 2);
+    for (int i = 0; i < n; i++) {
+        const char *eq = strchr(meta[i], '=');
+        o->meta[i * 2] = ts_intern(meta[i], eq - meta[i]);
+        o->meta[i * 2 + 1] = ts_intern(eq + 1, strlen(eq + 1));
+    }
+    o->nmeta = n;
+}
+
+int ts_set_meta_buf(struct TSObject *o, const char *buf, size_t len) {
+    int n = 0;
+    for (size_t i = 0; i < len; i++)
+        n += !buf[i];
+
+    char *meta[n ? n : 1];
+    const char *p = buf;
+    for (int i = 0; i < n; i++, p += strlen(p) + 1) {
+        if (!strchr(p, '='))
+            return REDISMODULE_ERR;
+        meta[i] = (char *)p;
+    }
+    ts_set_meta(o, meta, n);
+    return REDISMODULE_OK;
+}
+
+/* Metadata as "label=value" strings back to back, in a buffer of *len bytes to free */
+static char *ts_meta_buf(struct TSObject *o, size_t *len) {
+    *len = 0;
+    for (size_t i = 0; i < o->nmeta * 2; i++)
+        *len += strlen(ts_intern_str(o->meta[i])) + 1;
+    char *meta = RedisModule_Alloc(*len + 1), *p = meta;
+    for (size_t i = 0; i < o->nmeta; i++)
+        p += sprintf(p, "%s=%s", ts_intern_str(o->meta[i * 2]), ts_intern_str(o->meta[i * 2 + 1])) + 1;
+    return meta;
+}
+
+TSAtom ts_meta(struct TSObject *o, TSAtom label) {
+    for (size_t i = 0; label != TS_ATOM_NONE && i < o->nmeta; i++)
+        if (o->meta[i * 2] == label)
+            return o->meta[i * 2 + 1];
+    return TS_ATOM_NONE;
+}
+
+/* Slot of the source partition, or the empty slot where it belongs */
+static TSOffset *ts_offset_slot(struct TSObject *o, TSAtom source, uint32_t partition) {
+    uint32_t mask = o->offsets_size - 1;
+    uint32_t i = ((source * 2654435761u) ^ partition) & mask;
+
+    while (o->offsets[i].source != TS_ATOM_NONE &&
+           (o->offsets[i].source != source || o->offsets[i].partition != partition))
+        i = (i + 1) & mask;
+    return &o->offsets[i];
+}
+
+int ts_offset_new(struct TSObject *o, const char *source, uint32_t partition, long long offset) {
+    TSAtom id = ts_intern_find(source, strlen(source));
+    if (id == TS_ATOM_NONE || !o->offsets_size)
+        return 1;
+
+    TSOffset *slot = ts_offset_slot(o, id, partition);
+    return slot->source == TS_ATOM_NONE || offset > slot->offset;
+}
+
+void ts_offset_set(struct TSObject *o, const char *source, uint32_t partition, long long offset) {
+    // Keep the table at most half full
+    if ((o->noffsets + 1) * 2 > o->offsets_size) {
+        TSOffset *old = o->offsets;
+        uint32_t old_size = o->offsets_size;
+        o->offsets_size = old_size ? old_size * 2 : 4;
+        o->offsets = RedisModule_Calloc(o->offsets_size, sizeof(TSOffset));
+        for (uint32_t i = 0; i < old_size; i++)
+            if (old[i].source != TS_ATOM_NONE)
+                *ts_offset_slot(o, old[i].source, old[i].partition) = old[i];
+        RedisModule_Free(old);
+    }
+
+    TSAtom id = ts_intern_find(source, strlen(source));
+    TSOffset *slot = id == TS_ATOM_NONE ? NULL : ts_offset_slot(o, id, partition);
+    if (!slot || slot->source == TS_ATOM_NONE) {
+        id = ts_intern(source, strlen(source));
+        slot = ts_offset_slot(o, id, partition);
+        slot->source = id;
+        slot->partition = partition;
+        o->noffsets++;
+    }
+    slot->offset = offset;
+}
+
+static size_t ts_chunk_size(struct TSObject *o) {
+    return sizeof(TSEntry) * TS_CHUNK_ENTRIES * o->ncols;
+}
+
+static TSChunk *ts_chunk_create(struct TSObject *o) {
+    TSChunk *c = RedisModule_Calloc(1, sizeof(*c) + ts_chunk_size(o));
+    c->refcount = 1;
+    c->entry = c->data;
+    return c;
+}
+
+static void ts_chunk_retain(TSChunk *c) {
+    __atomic_add_fetch(&c->refcount, 1, __ATOMIC_RELAXED);
+}
+
+static void ts_chunk_release(TSChunk *c) {
+    if (c && __atomic_sub_fetch(&c->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (c->cold_size)
+            ts_cold_free(c->entry, c->cold_size);
+        RedisModule_Free(c);
+    }
+}
+
+/* Move the chunks before chunk n whose buckets are all older than COLD_AGE to the cold tier.
+ * Chunks are moved in order, the sweep stops at the first one that is too young. */
+static void ts_cold_sweep(struct TSObject *o, size_t n) {
+    if (!ts_options.cold_dir)
+        return;
+
+    time_t now = time(NULL);
+    for (; o->cold < n; o->cold++) {
+        // Start of the bucket after the chunk
+        time_t end = o->init_timestamp + (time_t)(o->cold + 1) * TS_CHUNK_ENTRIES * o->interval;
+        if (end > now - ts_options.cold_age)
+            return;
+
+        TSChunk *c = o->chunks[o->cold];
+        if (!c || c->entry != c->data)
+            continue;
+        TSEntry *entry = ts_cold_store(c->entry, ts_chunk_size(o));
+        if (!entry)
+            return;
+        TSChunk *cold = RedisModule_Alloc(sizeof(*cold));
+        cold->refcount = 1;
+        cold->cold_size = ts_chunk_size(o);
+        cold->entry = entry;
+        o->chunks[o->cold] = cold;
+        ts_chunk_release(c);
+    }
+}
+
+/* Return the entry of column col at idx for update, growing the series if needed.
+ * A chunk pinned by a reader or in the cold tier is copied before it is modified. A new chunk seals the chunks
+ * before it, and they're swept to the cold tier if sweep is set. */
+static void ts_chunks_grow(struct TSObject *o, size_t n) {
+    if (n >= o->nchunks) {
+        o->chunks = RedisModule_Realloc(o->chunks, sizeof(TSChunk *) * (n + 1));
+        memset(&o->chunks[o->nchunks], 0, sizeof(TSChunk *) * (n + 1 - o->nchunks));
+        o->nchunks = n + 1;
+    }
+}
+
+static TSEntry *ts_entry_write(struct TSObject *o, size_t idx, size_t col, int sweep) {
+    size_t n = idx / TS_CHUNK_ENTRIES;
+
+    ts_chunks_grow(o, n);
+    if (idx >= o->len)
+        o->len = idx + 1;
+
+    TSChunk *c = o->chunks[n];
+    if (!c) {
+        c = o->chunks[n] = ts_chunk_create(o);
+        // The series moved past the chunks before, they're sealed
+        if (sweep)
+            ts_cold_sweep(o, n);
+    } else if (c->entry != c->data || __atomic_load_n(&c->refcount, __ATOMIC_ACQUIRE) > 1) {
+        TSChunk *copy = RedisModule_Alloc(sizeof(*copy) + ts_chunk_size(o));
+        memcpy(copy->data, c->entry, ts_chunk_size(o));
+        copy->refcount = 1;
+        copy->cold_size = 0;
+        copy->entry = copy->data;
+        ts_chunk_release(c);
+        c = o->chunks[n] = copy;
+    }
+    return &c->entry[col * TS_CHUNK_ENTRIES + idx % TS_CHUNK_ENTRIES];
+}
+
+static void ts_entry_add(struct TSObject *o, size_t idx, size_t col, unsigned count, double sum, int sweep) {
+    TSEntry *e = ts_entry_write(o, idx, col, sweep);
+    e->avg = (e->avg * e->count + sum) / (e->count + count);
+    e->count += count;
+}
+
+static void ts_fold(struct TSObject *o, int sweep) {
+    for (size_t i = 0; i < o->npending; i++)
+        ts_entry_add(o, o->pending[i].idx, o->pending[i].col, o->pending[i].count, o->pending[i].sum, sweep);
+    o->npending = 0;
+}
+
+void ts_flush(struct TSObject *o) {
+    ts_fold(o, 1);
+}
+
+/* In write behind mode inserts are staged, and inserts to a bucket that is already staged
+ * for the current row are coalesced into a single delta. The staged deltas are folded once
+ * WRITE_BEHIND of them accumulate, or before the series is read. */
+static void ts_add(struct TSObject *o, size_t idx, size_t col, double value) {
+    if (!ts_options.write_behind) {
+        ts_entry_add(o, idx, col, 1, value, 1);
+        return;
+    }
+
+    for (size_t i = o->npending; i > 0 && i + o->ncols > o->npending; i--) {
+        TSDelta *d = &o->pending[i - 1];
+        if (d->idx == idx && d->col == col) {
+            d->count++;
+            d->sum += value;
+            return;
+        }
+    }
+    if (!o->pending)
+        o->pending = RedisModule_Alloc(sizeof(TSDelta) * ts_options.write_behind);
+    else if (o->npending == ts_options.write_behind)
+        ts_flush(o);
+    o->pending[o->npending++] = (TSDelta){ .idx = idx, .col = col, .count = 1, .sum = value };
+    if (idx >= o->len)
+        o->len = idx + 1;
+}
+
+const char *ts_timestamp_check(struct TSObject *o, time_t *timestamp, int late, TSOutlier *outlier) {
+    time_t now = time(NULL), min = o->init_timestamp;
+    TSOutlierPolicy policy = ts_options.outlier_policy;
+
+    *outlier = ts_outlier_none;
+    // The window edges are only truncated to buckets when the plain time compare fails
+    if (ts_options.max_future && *timestamp > now + ts_options.max_future) {
+        time_t max = interval_epoch(o->interval, now + ts_options.max_future);
+        if (*timestamp > max) {
+            *outlier = ts_outlier_future;
+            if (policy == ts_outlier_reject)
+                return "ERR invalid value: Time Stamp is too far in the future";
+            *timestamp = policy == ts_outlier_drop ? 0 : max > min ? max : min;
+            return NULL;
+        }
+    }
+    if (late && ts_options.late_window && *timestamp < now - ts_options.late_window) {
+        time_t window = interval_epoch(o->interval, now - ts_options.late_window);
+        if (window > min)
+            min = window;
+    }
+    if (*timestamp < min) {
+        *outlier = ts_outlier_late;
+        if (policy == ts_outlier_reject)
+            return "ERR invalid value: Time Stamp is too early";
+        *timestamp = policy == ts_outlier_drop ? 0 : min;
+    }
+    return NULL;
+}
+
+void ts_outlier_count(struct TSObject *o, TSOutlier outlier) {
+    o->late += outlier == ts_outlier_late;
+    o->future += outlier == ts_outlier_future;
+}
+
+void TSAddItem(struct TSObject *o, double value, time_t timestamp) {
+    ts_add(o, idx_timestamp(o->init_timestamp, timestamp, o->interval), 0, value);
+}
+
+void TSAddRow(struct TSObject *o, const double *values, time_t timestamp) {
+    size_t idx = idx_timestamp(o->init_timestamp, timestamp, o->interval);
+
+    for (size_t col = 0; col < o->ncols; col++)
+        ts_add(o, idx, col, values[col]);
+}
+
+void ts_add_bucket(struct TSObject *o, size_t idx, unsigned count, const double *sums) {
+    for (size_t col = 0; col < o->ncols; col++)
+        ts_entry_add(o, idx, col, count, sums[col], 1);
+}
+
+void ts_range_pin(struct TSObject *o, size_t from, size_t len, TSRange *r) {
+    size_t first = from / TS_CHUNK_ENTRIES;
+
+    ts_flush(o);
+
+    r->offset = from % TS_CHUNK_ENTRIES;
+    r->len = len;
+    r->nchunks = len ? (r->offset + len - 1) / TS_CHUNK_ENTRIES + 1 : 0;
+    r->chunks = RedisModule_Alloc(sizeof(TSChunk *) * (r->nchunks ? r->nchunks : 1));
+    for (size_t i = 0; i < r->nchunks; i++) {
+        TSChunk *c = first + i < o->nchunks ? o->chunks[first + i] : NULL;
+        r->chunks[i] = c ? c : &empty.chunk;
+        ts_chunk_retain(r->chunks[i]);
+    }
+}
+
+void ts_range_release(TSRange *r) {
+    for (size_t i = 0; i < r->nchunks; i++)
+        ts_chunk_release(r->chunks[i]);
+    RedisModule_Free(r->chunks);
+    r->chunks = NULL;
+    r->nchunks = 0;
+}
+
+static void ts_merge_entries(double *restrict sum, double *restrict count, const TSEntry *restrict e, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        sum[i] += e[i].avg * e[i].count;
+        count[i] += e[i].count;
+    }
+}
+
+/* Merge chunk by chunk, so the inner loop runs over contiguous entries */
+void ts_range_merge(TSRange *r, size_t col, double *sum, double *count) {
+    size_t pos = r->offset;
+
+    for (size_t done = 0; done < r->len;) {
+        size_t i = pos % TS_CHUNK_ENTRIES;
+        size_t n = TS_CHUNK_ENTRIES - i < r->len - done ? TS_CHUNK_ENTRIES - i : r->len - done;
+        ts_merge_entries(&sum[done], &count[done],
+            &r->chunks[pos / TS_CHUNK_ENTRIES]->entry[col * TS_CHUNK_ENTRIES + i], n);
+        pos += n;
+        done += n;
+    }
+}
+
+static char *ts_pack_le(char *p, uint64_t v, size_t n) {
+    for (size_t i = 0; i < n; i++, v >>= 8)
+        *p++ = (char)(v & 0xff);
+    return p;
+}
+
+size_t ts_range_pack(TSRange *r, const size_t *cols, size_t ncols, char *buf) {
+    char *p = buf;
+
+    for (size_t i = 0; i < r->len; i++) {
+        for (size_t j = 0; j < ncols; j++) {
+            TSEntry *e = ts_range_entry(r, i, cols[j]);
+            double sum = e->avg * e->count;
+            uint64_t bits;
+            memcpy(&bits, &sum, sizeof(bits));
+            p = ts_pack_le(p, e->count, 4);
+            p = ts_pack_le(p, bits, 8);
+        }
+    }
+    return p - buf;
+}
+
 void TSReleaseObject(struct TSObject *o) {
-    RedisModule_Free(o->entry);
+    for (size_t i = 0; i < o->nchunks; i++)
+        ts_chunk_release(o->chunks[i]);
+    RedisModule_Free(o->chunks);
+    for (size_t i = 0; o->columns && i < o->ncols; i++)
+        ts_intern_release(o->columns[i]);
+    RedisModule_Free(o->columns);
+    ts_release_meta(o);
+    for (uint32_t i = 0; i < o->offsets_size; i++)
+        ts_intern_release(o->offsets[i].source);
+    RedisModule_Free(o->offsets);
+    RedisModule_Free(o->pending);
+    ts_timefmt_free(o->timefmt);
     RedisModule_Free(o);
 }
 
+/* Entries saved before version 6 had an unsigned short count, the padding after it is ignored */
+static void ts_chunk_widen(TSChunk *c, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        unsigned short count;
+        memcpy(&count, &c->entry[i], sizeof(count));
+        c->entry[i].count = count;
+    }
+}
+
 void *TSRdbLoad(RedisModuleIO *rdb, int encver) {
-    if (encver != 0) {
-        /* RedisModule_Log("warning","Can't load data with version %d", encver);*/
+    if (encver < 1 || encver > TS_ENCVER) {
+        RedisModule_LogIOError(rdb, "warning", "Can't load time series data with version %d", encver);
         return NULL;
     }
 
     struct TSObject *tso = createTSObject();
+    tso->interval = RedisModule_LoadUnsigned(rdb);
+    tso->init_timestamp = RedisModule_LoadSigned(rdb);
+    // Versions before 7 read timestamps in local time. The start moves to the UTC time that reads the same, so every
+    // bucket keeps its date and hour.
+    if (encver < 7) {
+        struct tm st;
+        time_t local = tso->init_timestamp;
+        tso->init_timestamp = ts_timegm(localtime_r(&local, &st));
+    }
+    tso->timefmt = ts_timefmt_default();
     tso->len = RedisModule_LoadUnsigned(rdb);
-    size_t len = 0;
-    if (tso->len)
-        tso->entry = (TSEntry *)RedisModule_LoadStringBuffer(rdb, &len);
+    // Version 1 had no column names, every series had a single value column
+    if (encver >= 2) {
+        size_t ncols = RedisModule_LoadUnsigned(rdb);
+        if (ncols > TS_MAX_COLUMNS) {
+            RedisModule_LogIOError(rdb, "warning", "Can't load time series with %zu columns", ncols);
+            TSReleaseObject(tso);
+            return NULL;
+        }
+        if (ncols) {
+            tso->ncols = ncols;
+            tso->columns = RedisModule_Alloc(sizeof(TSAtom) * ncols);
+            for (size_t i = 0; i < ncols; i++) {
+                char *column = RedisModule_LoadStringBuffer(rdb, NULL);
+                tso->columns[i] = ts_intern(column, strlen(column));
+                RedisModule_Free(column);
+            }
+        }
+    }
+    if (encver >= 3) {
+        size_t len;
+        char *buf = RedisModule_LoadStringBuffer(rdb, &len);
+        int rc = ts_set_meta_buf(tso, buf, len);
+        RedisModule_Free(buf);
+        if (rc != REDISMODULE_OK) {
+            RedisModule_LogIOError(rdb, "warning", "Can't load time series metadata without a label");
+            TSReleaseObject(tso);
+            return NULL;
+        }
+    }
+    if (encver >= 4) {
+        size_t n = RedisModule_LoadUnsigned(rdb);
+        for (size_t i = 0; i < n; i++) {
+            char *source = RedisModule_LoadStringBuffer(rdb, NULL);
+            uint32_t partition = RedisModule_LoadUnsigned(rdb);
+            ts_offset_set(tso, source, partition, RedisModule_LoadSigned(rdb));
+            RedisModule_Free(source);
+        }
+    }
+    // Earlier versions always used DEFAULT_TIMEFMT
+    if (encver >= 5) {
+        char *timefmt = RedisModule_LoadStringBuffer(rdb, NULL);
+        tso->timefmt = ts_timefmt_new(timefmt);
+        RedisModule_Free(timefmt);
+    }
+    tso->nchunks = RedisModule_LoadUnsigned(rdb);
+    tso->chunks = RedisModule_Calloc(tso->nchunks ? tso->nchunks : 1, sizeof(TSChunk *));
+    for (size_t i = 0; i < tso->nchunks; i++) {
+        size_t len = 0;
+        char *buf = RedisModule_LoadStringBuffer(rdb, &len);
+        if (len == ts_chunk_size(tso)) {
+            tso->chunks[i] = ts_chunk_create(tso);
+            memcpy(tso->chunks[i]->entry, buf, len);
+            if (encver < 6)
+                ts_chunk_widen(tso->chunks[i], len / sizeof(TSEntry));
+        }
+        RedisModule_Free(buf);
+    }
+    ts_cold_sweep(tso, tso->nchunks ? tso->nchunks - 1 : 0);
 
     return tso;
 }
 
 void TSRdbSave(RedisModuleIO *rdb, void *value) {
     struct TSObject *tso = value;
-    RedisModule_SaveUnsigned(rdb,tso->len);
-    if (tso->len)
-        RedisModule_SaveStringBuffer(rdb,(const char *)tso->entry,tso->len * sizeof(double));
+    // A BGSAVE child runs this too. Its copy of the cold file state is stale, so a save never sweeps.
+    ts_fold(tso, 0);
+    RedisModule_SaveUnsigned(rdb, tso->interval);
+    RedisModule_SaveSigned(rdb, tso->init_timestamp);
+    RedisModule_SaveUnsigned(rdb, tso->len);
+    RedisModule_SaveUnsigned(rdb, tso->columns ? tso->ncols : 0);
+    for (size_t i = 0; tso->columns && i < tso->ncols; i++)
+        RedisModule_SaveStringBuffer(rdb, ts_column_name(tso, i), strlen(ts_column_name(tso, i)) + 1);
+
+    size_t meta_len;
+    char *meta = ts_meta_buf(tso, &meta_len);
+    RedisModule_SaveStringBuffer(rdb, meta, meta_len);
+    RedisModule_Free(meta);
+
+    RedisModule_SaveUnsigned(rdb, tso->noffsets);
+    for (uint32_t i = 0; i < tso->offsets_size; i++) {
+        TSOffset *o = &tso->offsets[i];
+        if (o->source == TS_ATOM_NONE)
+            continue;
+        RedisModule_SaveStringBuffer(rdb, ts_intern_str(o->source), strlen(ts_intern_str(o->source)) + 1);
+        RedisModule_SaveUnsigned(rdb, o->partition);
+        RedisModule_SaveSigned(rdb, o->offset);
+    }
+    RedisModule_SaveStringBuffer(rdb, tso->timefmt->format, strlen(tso->timefmt->format) + 1);
+    RedisModule_SaveUnsigned(rdb, tso->nchunks);
+    // Chunks that were never written are saved as empty buffers
+    for (size_t i = 0; i < tso->nchunks; i++) {
+        TSChunk *c = tso->chunks[i];
+        RedisModule_SaveStringBuffer(rdb, c ? (const char *)c->entry : "", c ? ts_chunk_size(tso) : 0);
+    }
 }
 
+const char *ts_restore_chunk(struct TSObject *o, size_t n, const char *buf, size_t len) {
+    if (len != ts_chunk_size(o))
+        return "ERR invalid value: chunk size doesn't match the series columns";
+    if (n * TS_CHUNK_ENTRIES >= o->len)
+        return "ERR invalid value: chunk is past the end of the series";
+
+    ts_chunks_grow(o, n);
+    if (o->chunks[n])
+        ts_chunk_release(o->chunks[n]);
+    o->chunks[n] = ts_chunk_create(o);
+    memcpy(o->chunks[n]->entry, buf, len);
+    ts_cold_sweep(o, o->nchunks - 1);
+    return NULL;
+}
+
+/* TS.INSERT can't reproduce an aggregated entry, the series is rebuilt by TS.RESTORE from the parts TSRdbSave
+ * saves */
 void TSAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
     struct TSObject *tso = value;
-    if(tso->entry) {
-        RedisModule_EmitAOF(aof,"TS.INSERT","sc",key,tso->entry);
+    // The rewrite runs in a child, like a BGSAVE
+    ts_fold(tso, 0);
+
+    size_t columns_len = 0;
+    for (size_t i = 0; tso->columns && i < tso->ncols; i++)
+        columns_len += strlen(ts_column_name(tso, i)) + 1;
+    char columns[columns_len + 1], *p = columns;
+    for (size_t i = 0; tso->columns && i < tso->ncols; i++)
+        p += sprintf(p, "%s", ts_column_name(tso, i)) + 1;
+    RedisModule_EmitAOF(aof, "TS.RESTORE", "sclllcb", key, "SERIES", (long long)tso->interval,
+                        (long long)tso->init_timestamp, (long long)tso->len, tso->timefmt->format, columns,
+                        columns_len);
+
+    if (tso->nmeta) {
+        size_t meta_len;
+        char *meta = ts_meta_buf(tso, &meta_len);
+        RedisModule_EmitAOF(aof, "TS.RESTORE", "scb", key, "META", meta, meta_len);
+        RedisModule_Free(meta);
+    }
+    for (uint32_t i = 0; i < tso->offsets_size; i++) {
+        TSOffset *o = &tso->offsets[i];
+        if (o->source != TS_ATOM_NONE)
+            RedisModule_EmitAOF(aof, "TS.RESTORE", "sccll", key, "OFFSET", ts_intern_str(o->source),
+                                (long long)o->partition, o->offset);
     }
+    for (size_t i = 0; i < tso->nchunks; i++)
+        if (tso->chunks[i])
+            RedisModule_EmitAOF(aof, "TS.RESTORE", "sclb", key, "CHUNK", (long long)i,
+                                (const char *)tso->chunks[i]->entry, ts_chunk_size(tso));
 }
 
 void TSDigest(RedisModuleDigest *digest, void *value) {
@@ -52,5 +580,5 @@ void TSFree(void *value) {
 
 RedisModuleType *create_ts_entry_type(RedisModuleCtx *ctx) {
     /* Name must be 9 chars... */
-    return RedisModule_CreateDataType(ctx, "timeserie", 0, TSRdbLoad, TSRdbSave, TSAofRewrite, TSDigest, TSFree);
-}
\ No newline at end of file
+    return RedisModule_CreateDataType(ctx, "timeserie", TS_ENCVER, TSRdbLoad, TSRdbSave, TSAofRewrite, TSDigest, TSFree);
+}
@@ -2,22 +2,160 @@
 #define _TS_ENTRY_
 
 #include "timeseries.h"
+#include "ts_intern.h"
+#include "ts_time.h"
 
 typedef struct TSEntry {
-    unsigned short count;
+    uint32_t count;     // An unsigned short before RDB version 6, in the same 16 bytes
     double avg;
 }TSEntry;
 
+// Buckets per chunk
+#define TS_CHUNK_ENTRIES 256
+
+// Value columns of a series sharing one time axis
+#define TS_MAX_COLUMNS 64
+
+/* Entries are stored in fixed size, reference counted chunks. The series holds one reference,
+ * every reader pinning a range holds another. A chunk with more than one reference is never
+ * modified: the writer replaces it with a private copy first. Readers can therefore use a
+ * pinned range off the main thread without locks.
+ * A chunk holds TS_CHUNK_ENTRIES buckets of every column, column after column. The entries of a chunk in the
+ * cold tier are mapped from the cold file, and are copied back to memory before they're modified. */
+typedef struct TSChunk {
+    int refcount;
+    size_t cold_size;   // Bytes of the mapped entries of a cold chunk, 0 for a chunk in memory
+    TSEntry *entry;     // data, or the mapped entries of a cold chunk
+    TSEntry data[];
+}TSChunk;
+
+/* Inserts staged for a bucket in write behind mode */
+typedef struct TSDelta {
+    size_t idx;
+    size_t col;
+    unsigned count;
+    double sum;
+}TSDelta;
+
+/* Last offset inserted from a source partition, for exactly once ingestion */
+typedef struct TSOffset {
+    TSAtom source;      // TS_ATOM_NONE for an empty slot
+    uint32_t partition;
+    long long offset;
+}TSOffset;
+
 typedef struct TSObject {
-    TSEntry *entry;
+    TSChunk **chunks;   // NULL for chunks that were never written
+    size_t nchunks;
     size_t len;
+    size_t ncols;
+    TSAtom *columns;    // Column names, NULL for a single value series
+    TSAtom *meta;       // Metadata labels, each label followed by its value
+    size_t nmeta;       // Number of labels
+    TSOffset *offsets;  // Open addressing table of the source partitions inserted with an offset
+    uint32_t noffsets;
+    uint32_t offsets_size;
+    TSDelta *pending;   // Staged inserts, folded into the chunks before any read
+    size_t npending;
+    size_t cold;        // Chunks before this one were considered for the cold tier
+    size_t late;        // Late values rejected, dropped or clamped since load, see ts_timestamp_check
+    size_t future;      // Future values rejected, dropped or clamped since load
     time_t init_timestamp;
     Interval interval;
-    const char *timefmt;
+    const TSTimeFmt *timefmt;
 }TSObject;
 
+/* A pinned, immutable view of len entries of a series, starting at offset in chunks[0] */
+typedef struct TSRange {
+    TSChunk **chunks;
+    size_t nchunks;
+    size_t offset;
+    size_t len;
+}TSRange;
+
 struct TSObject *createTSObject(void);
 
+void TSReleaseObject(struct TSObject *o);
+
+/* Turn an empty series into a group of ncols named value columns */
+void ts_set_columns(struct TSObject *o, size_t ncols, const char **columns);
+
+/* Index of a column by name, or -1 */
+int ts_column(struct TSObject *o, const char *name);
+
+static inline const char *ts_column_name(struct TSObject *o, size_t col) {
+    return ts_intern_str(o->columns[col]);
+}
+
+/* Attach n "label=value" metadata labels to a series, replacing the previous ones */
+void ts_set_meta(struct TSObject *o, char **meta, int n);
+
+/* Attach the metadata saved as "label=value" strings back to back in len bytes of buf.
+ * Returns REDISMODULE_ERR, leaving the metadata as it was, if a string has no '='. */
+int ts_set_meta_buf(struct TSObject *o, const char *buf, size_t len);
+
+/* Value of a metadata label, or TS_ATOM_NONE */
+TSAtom ts_meta(struct TSObject *o, TSAtom label);
+
+/* Is offset past the last one inserted from the source partition? */
+int ts_offset_new(struct TSObject *o, const char *source, uint32_t partition, long long offset);
+
+/* Record offset as the last one inserted from the source partition */
+void ts_offset_set(struct TSObject *o, const char *source, uint32_t partition, long long offset);
+
+/* What ts_timestamp_check found a timestamp to be */
+typedef enum {
+    ts_outlier_none,
+    ts_outlier_late,    // Before the late window or the series start
+    ts_outlier_future   // Past the future horizon
+} TSOutlier;
+
+/* Apply the MAX_FUTURE and, if late is set, the LATE_WINDOW options to a resolved timestamp.
+ * Timestamps before the start of o are always outliers. Returns an error if the value is rejected, otherwise NULL
+ * with *timestamp clamped into the window, or set to 0 if the value is dropped. *outlier is set either way, for
+ * ts_outlier_count once the value is actually rejected, added or dropped. */
+const char *ts_timestamp_check(struct TSObject *o, time_t *timestamp, int late, TSOutlier *outlier);
+
+/* Count an outlier in the late or future values of o */
+void ts_outlier_count(struct TSObject *o, TSOutlier outlier);
+
+/* Add value to the bucket of timestamp */
+void TSAddItem(struct TSObject *o, double value, time_t timestamp);
+
+/* Add one value per column to the bucket of timestamp */
+void TSAddRow(struct TSObject *o, const double *values, time_t timestamp);
+
+/* Add count rows whose values sum to sums[col] to bucket idx, bypassing write behind staging */
+void ts_add_bucket(struct TSObject *o, size_t idx, unsigned count, const double *sums);
+
+/* Fold the staged inserts of o into its buckets */
+void ts_flush(struct TSObject *o);
+
+/* Replace chunk n of o with len bytes of its entries, as TSRdbSave saves them.
+ * Returns an error message, or NULL. */
+const char *ts_restore_chunk(struct TSObject *o, size_t n, const char *buf, size_t len);
+
+/* Pin entries [from, from + len) of o. Must be called on the main thread. */
+void ts_range_pin(struct TSObject *o, size_t from, size_t len, TSRange *r);
+
+/* Unpin a range. Can be called from any thread. */
+void ts_range_release(TSRange *r);
+
+/* Add the sum and count of every bucket of column col in r to sum[i] and count[i] */
+void ts_range_merge(TSRange *r, size_t col, double *sum, double *count);
+
+/* Bytes of a packed bucket: little endian uint32 count followed by little endian float64 sum */
+#define TS_PACKED_ENTRY 12
+
+/* Pack the ncols columns cols of every bucket of r into buf, bucket by bucket.
+ * buf must hold r->len * ncols * TS_PACKED_ENTRY bytes. Returns the bytes written. */
+size_t ts_range_pack(TSRange *r, const size_t *cols, size_t ncols, char *buf);
+
+static inline TSEntry *ts_range_entry(TSRange *r, size_t i, size_t col) {
+    size_t pos = r->offset + i;
+    return &r->chunks[pos / TS_CHUNK_ENTRIES]->entry[col * TS_CHUNK_ENTRIES + pos % TS_CHUNK_ENTRIES];
+}
+
 RedisModuleType *create_ts_entry_type(RedisModuleCtx *ctx);
 
-#endif
\ No newline at end of file
+#endif
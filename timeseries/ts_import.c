@@ -0,0 +1,192 @@
+#include "ts_import.h"
+#include "ts_utils.h"
+
+// Longest csv field
+#define TS_IMPORT_FIELD 64
+
+/* Rows summed per bucket, added to the series once the whole input parsed */
+typedef struct TSImportBuckets {
+    struct TSObject *o;
+    size_t len;
+    size_t size;
+    size_t *idx;
+    unsigned *count;
+    double *sums;       // ncols per bucket
+    time_t bucket;      // Bucket of the last epoch timestamp, for the times [from, to)
+    time_t from;
+    time_t to;
+    int digits;         // Length of all digit timestamps of the series format, 0 if it has none
+    size_t late;        // Outliers dropped or clamped, counted on the series once the import is added
+    size_t future;
+} TSImportBuckets;
+
+static void ts_import_add(TSImportBuckets *b, size_t idx, const double *values) {
+    size_t ncols = b->o->ncols;
+
+    if (!b->len || b->idx[b->len - 1] != idx) {
+        if (b->len == b->size) {
+            b->size = b->size ? b->size * 2 : 256;
+            b->idx = RedisModule_Realloc(b->idx, sizeof(size_t) * b->size);
+            b->count = RedisModule_Realloc(b->count, sizeof(unsigned) * b->size);
+            b->sums = RedisModule_Realloc(b->sums, sizeof(double) * ncols * b->size);
+        }
+        b->idx[b->len] = idx;
+        b->count[b->len] = 0;
+        memset(&b->sums[b->len * ncols], 0, sizeof(double) * ncols);
+        b->len++;
+    }
+
+    double *sums = &b->sums[(b->len - 1) * ncols];
+    b->count[b->len - 1]++;
+    for (size_t col = 0; col < ncols; col++)
+        sums[col] += values[col];
+}
+
+/* Epoch seconds, truncated to their interval. Sorted input mostly hits the bucket of the previous row. */
+static time_t ts_import_epoch(TSImportBuckets *b, time_t t) {
+    if (t >= b->from && t < b->to)
+        return b->bucket;
+
+    b->bucket = interval_range(b->o->interval, t, &b->from, &b->to);
+    return b->bucket;
+}
+
+static const char *ts_import_row(TSImportBuckets *b, time_t timestamp, const double *values) {
+    if (!timestamp)
+        return "ERR invalid value: Time Stamp is not valid";
+    // Backfills are expected to be late, only the future horizon and the series start apply
+    TSOutlier outlier;
+    const char *err = ts_timestamp_check(b->o, &timestamp, 0, &outlier);
+    if (err) {
+        ts_outlier_count(b->o, outlier);
+        return err;
+    }
+    b->late += outlier == ts_outlier_late;
+    b->future += outlier == ts_outlier_future;
+    if (!timestamp)
+        return NULL;
+
+    ts_import_add(b, idx_timestamp(b->o->init_timestamp, timestamp, b->o->interval), values);
+    return NULL;
+}
+
+/* Copy the field at *p into buf, and move *p past it. *more is set if another field follows. */
+static int ts_import_field(const char **p, const char *end, char *buf, int *more) {
+    const char *comma = memchr(*p, ',', end - *p);
+    const char *stop = comma ? comma : end;
+
+    if (stop - *p >= TS_IMPORT_FIELD)
+        return 0;
+    memcpy(buf, *p, stop - *p);
+    buf[stop - *p] = '\0';
+    *p = comma ? comma + 1 : end;
+    *more = comma != NULL;
+    return 1;
+}
+
+/* A timestamp in the series format, or else epoch seconds */
+static time_t ts_import_timestamp(TSImportBuckets *b, const char *s) {
+    const char *p = s;
+    time_t t = 0;
+
+    while (*p >= '0' && *p <= '9' && p - s < 18)
+        t = t * 10 + (*p++ - '0');
+    if (p == s || *p)
+        return interval2timestamp(b->o->interval, s, b->o->timefmt);
+
+    /* All digits are epoch seconds, unless they're as long as the timestamps of a format like "%Y%m%d%H" and read
+     * as a time of the series in it. 1451995200 is 2016-01-05 12:00:00, but no hour of "%Y%m%d%H". */
+    struct tm st = {0};
+    if (p - s == b->digits && ts_timefmt_exact(b->o->timefmt, s, &st)) {
+        time_t timestamp = interval_epoch(b->o->interval, ts_timegm(&st));
+        if (timestamp >= b->o->init_timestamp)
+            return timestamp;
+    }
+    return ts_import_epoch(b, t);
+}
+
+static const char *ts_import_csv_rows(TSImportBuckets *b, const char *data, size_t len, size_t *rows) {
+    const char *p = data, *end = data + len;
+    char field[TS_IMPORT_FIELD];
+    double values[b->o->ncols];
+
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        const char *line = p, *line_end = eol ? eol : end;
+        p = eol ? eol + 1 : end;
+
+        if (line_end > line && line_end[-1] == '\r')
+            line_end--;
+        if (line_end == line)
+            continue;
+        (*rows)++;
+
+        int more;
+        if (!ts_import_field(&line, line_end, field, &more))
+            return "ERR invalid value: Time Stamp is not valid";
+        time_t timestamp = ts_import_timestamp(b, field);
+
+        for (size_t col = 0; col < b->o->ncols; col++) {
+            char *eptr;
+            if (!more || !ts_import_field(&line, line_end, field, &more))
+                return "ERR invalid value: expecting a value per column";
+            values[col] = strtod(field, &eptr);
+            if (eptr == field || *eptr)
+                return "ERR invalid value: must be a double";
+        }
+        if (more)
+            return "ERR invalid value: expecting a value per column";
+
+        const char *err = ts_import_row(b, timestamp, values);
+        if (err)
+            return err;
+    }
+    return NULL;
+}
+
+static uint64_t ts_import_le(const char *p) {
+    uint64_t v = 0;
+
+    for (int i = 7; i >= 0; i--)
+        v = v << 8 | (unsigned char)p[i];
+    return v;
+}
+
+static const char *ts_import_bin_rows(TSImportBuckets *b, const char *data, size_t len, size_t *rows) {
+    size_t row = 8 * (1 + b->o->ncols);
+    double values[b->o->ncols];
+
+    if (len % row)
+        return "ERR invalid value: size isn't a multiple of the row size";
+
+    for (const char *p = data; p < data + len; p += row) {
+        (*rows)++;
+        for (size_t col = 0; col < b->o->ncols; col++) {
+            uint64_t bits = ts_import_le(p + 8 * (1 + col));
+            memcpy(&values[col], &bits, sizeof(double));
+        }
+        const char *err = ts_import_row(b, ts_import_epoch(b, (int64_t)ts_import_le(p)), values);
+        if (err)
+            return err;
+    }
+    return NULL;
+}
+
+const char *ts_import(struct TSObject *o, const char *data, size_t len, TSImportFormat format, size_t *rows) {
+    TSImportBuckets b = { .o = o, .digits = ts_timefmt_digits(o->timefmt) };
+
+    *rows = 0;
+    const char *err = format == ts_import_csv ? ts_import_csv_rows(&b, data, len, rows)
+                                              : ts_import_bin_rows(&b, data, len, rows);
+    for (size_t i = 0; !err && i < b.len; i++)
+        ts_add_bucket(o, b.idx[i], b.count[i], &b.sums[i * o->ncols]);
+    if (!err) {
+        o->late += b.late;
+        o->future += b.future;
+    }
+
+    RedisModule_Free(b.idx);
+    RedisModule_Free(b.count);
+    RedisModule_Free(b.sums);
+    return err;
+}
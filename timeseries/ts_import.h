@@ -0,0 +1,17 @@
+#ifndef _TS_IMPORT_H_
+#define _TS_IMPORT_H_
+
+#include "timeseries.h"
+#include "ts_entry.h"
+
+typedef enum {
+    ts_import_csv,  // A "timestamp,value[,value...]" line per row, with o->timefmt timestamps or else epoch seconds
+    ts_import_bin   // Per row a little endian int64 of epoch seconds followed by a float64 per column
+} TSImportFormat;
+
+/* Import len bytes of rows into o, all of them or none. Every row holds a value per column of o.
+ * Rows are summed per bucket before they are added, which is cheapest when they're sorted by time.
+ * Returns NULL with *rows set to the rows imported, or an error with *rows set to the failing row. */
+const char *ts_import(struct TSObject *o, const char *data, size_t len, TSImportFormat format, size_t *rows);
+
+#endif
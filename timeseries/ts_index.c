@@ -0,0 +1,167 @@
+#include "ts_index.h"
+
+static void ts_index_call(RedisModuleCtx *ctx, const char *cmd, RedisModuleString *set, RedisModuleString *entity) {
+    RedisModuleCallReply *rep = RedisModule_Call(ctx, cmd, "ss", set, entity);
+    if (rep)
+        RedisModule_FreeCallReply(rep);
+}
+
+void ts_index_add(RedisModuleCtx *ctx, const char *name, const char *entity, size_t entity_len,
+                  char **labels, int nlabels) {
+    RedisModuleString *member = RedisModule_CreateString(ctx, entity, entity_len);
+    RedisModuleString *set = RedisModule_CreateStringPrintf(ctx, "%s" TS_INDEX_SUFFIX, name);
+
+    ts_index_call(ctx, "SADD", set, member);
+    RedisModule_FreeString(ctx, set);
+    for (int i = 0; i < nlabels; i++) {
+        set = RedisModule_CreateStringPrintf(ctx, "%s" TS_INDEX_SUFFIX ":%s", name, labels[i]);
+        ts_index_call(ctx, "SADD", set, member);
+        RedisModule_FreeString(ctx, set);
+
+        const char *eq = strchr(labels[i], '=');
+        RedisModuleString *value = RedisModule_CreateString(ctx, eq + 1, strlen(eq + 1));
+        set = RedisModule_CreateStringPrintf(ctx, "%s" TS_INDEX_SUFFIX ":%.*s", name, (int)(eq - labels[i]), labels[i]);
+        ts_index_call(ctx, "SADD", set, value);
+        RedisModule_FreeString(ctx, set);
+        RedisModule_FreeString(ctx, value);
+    }
+    RedisModule_FreeString(ctx, member);
+}
+
+int ts_index_filters(RedisModuleCtx *ctx, const char *name, RedisModuleString **argv, int argc, TSFilter *filters) {
+    for (int i = 0; i < argc; i++) {
+        size_t len;
+        const char *arg = RedisModule_StringPtrLen(argv[i], &len);
+        const char *eq = memchr(arg, '=', len);
+        if (!eq || eq == arg || (eq == arg + 1 && arg[0] == '!'))
+            return REDISMODULE_ERR;
+
+        // label!=value is indexed under label=value
+        filters[i].negate = eq[-1] == '!';
+        filters[i].meta = 0;
+        filters[i].label = arg;
+        filters[i].label_len = eq - arg - filters[i].negate;
+        filters[i].value = eq + 1;
+        filters[i].set = RedisModule_CreateStringPrintf(ctx, "%s" TS_INDEX_SUFFIX ":%.*s=%s",
+            name, filters[i].label_len, arg, eq + 1);
+    }
+    return REDISMODULE_OK;
+}
+
+RedisModuleString **ts_index_query(RedisModuleCtx *ctx, const char *name, TSFilter *filters, int nfilters,
+                                   size_t *count) {
+    RedisModuleString *sets[nfilters + 1];
+    RedisModuleCallReply *rep;
+    size_t nsets = 0;
+
+    // Intersect the positive terms, or start from every entity
+    for (int i = 0; i < nfilters; i++)
+        if (!filters[i].negate && !filters[i].meta)
+            sets[nsets++] = filters[i].set;
+    if (!nsets) {
+        sets[0] = RedisModule_CreateStringPrintf(ctx, "%s" TS_INDEX_SUFFIX, name);
+        rep = RedisModule_Call(ctx, "SMEMBERS", "s", sets[0]);
+        RedisModule_FreeString(ctx, sets[0]);
+    } else {
+        rep = RedisModule_Call(ctx, "SINTER", "v", sets, nsets);
+    }
+
+    size_t n = rep ? RedisModule_CallReplyLength(rep) : 0;
+    RedisModuleString **entities = RedisModule_Alloc(sizeof(RedisModuleString *) * (n ? n : 1));
+    *count = 0;
+    for (size_t j = 0; j < n; j++) {
+        RedisModuleString *entity = RedisModule_CreateStringFromCallReply(RedisModule_CallReplyArrayElement(rep, j));
+        int match = 1;
+        for (int i = 0; match && i < nfilters; i++) {
+            if (!filters[i].negate || filters[i].meta)
+                continue;
+            RedisModuleCallReply *member = RedisModule_Call(ctx, "SISMEMBER", "ss", filters[i].set, entity);
+            match = !member || RedisModule_CallReplyInteger(member) == 0;
+            if (member)
+                RedisModule_FreeCallReply(member);
+        }
+        if (match)
+            entities[(*count)++] = entity;
+        else
+            RedisModule_FreeString(ctx, entity);
+    }
+    if (rep)
+        RedisModule_FreeCallReply(rep);
+    return entities;
+}
+
+RedisModuleString **ts_index_values(RedisModuleCtx *ctx, const char *name, const char *label, size_t *count) {
+    RedisModuleString *set = RedisModule_CreateStringPrintf(ctx, "%s" TS_INDEX_SUFFIX ":%s", name, label);
+    RedisModuleCallReply *rep = RedisModule_Call(ctx, "SMEMBERS", "s", set);
+    RedisModule_FreeString(ctx, set);
+
+    *count = rep ? RedisModule_CallReplyLength(rep) : 0;
+    RedisModuleString **values = RedisModule_Alloc(sizeof(RedisModuleString *) * (*count ? *count : 1));
+    for (size_t i = 0; i < *count; i++)
+        values[i] = RedisModule_CreateStringFromCallReply(RedisModule_CallReplyArrayElement(rep, i));
+    if (rep)
+        RedisModule_FreeCallReply(rep);
+    return values;
+}
+
+/* Drop entity from the set of field=value, and value from the values of field once no entity has it */
+static void ts_index_drop(RedisModuleCtx *ctx, const char *name, const char *field, RedisModuleString *value,
+                          RedisModuleString *entity) {
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(value, &len);
+    RedisModuleString *set = RedisModule_CreateStringPrintf(ctx, "%s" TS_INDEX_SUFFIX ":%s=%.*s",
+        name, field, (int)len, str);
+    RedisModuleCallReply *rep = RedisModule_Call(ctx, "SREM", "ss", set, entity);
+    int removed = rep && RedisModule_CallReplyInteger(rep) == 1;
+    if (rep)
+        RedisModule_FreeCallReply(rep);
+
+    // An emptied set no longer exists
+    rep = removed ? RedisModule_Call(ctx, "EXISTS", "s", set) : NULL;
+    if (rep && RedisModule_CallReplyInteger(rep) == 0) {
+        RedisModuleString *values = RedisModule_CreateStringPrintf(ctx, "%s" TS_INDEX_SUFFIX ":%s", name, field);
+        ts_index_call(ctx, "SREM", values, value);
+        RedisModule_FreeString(ctx, values);
+    }
+    if (rep)
+        RedisModule_FreeCallReply(rep);
+    RedisModule_FreeString(ctx, set);
+}
+
+void ts_index_remove(RedisModuleCtx *ctx, const char *name, RedisModuleString *entity,
+                     const char **fields, int nfields) {
+    RedisModuleString *set = RedisModule_CreateStringPrintf(ctx, "%s" TS_INDEX_SUFFIX, name);
+    ts_index_call(ctx, "SREM", set, entity);
+    RedisModule_FreeString(ctx, set);
+
+    size_t len, name_len = strlen(name);
+    const char *key = RedisModule_StringPtrLen(entity, &len);
+    if (len <= name_len || key[name_len] != ':')
+        return;
+
+    // Split the key into its values, unless a value has a ':' of its own
+    const char *values[nfields + 1], *end = key + len;
+    int n = 0;
+    for (const char *p = key + name_len; p && n <= nfields; p = memchr(p + 1, ':', end - p - 1))
+        values[n++] = p + 1;
+    if (n == nfields) {
+        values[n] = end + 1;
+        for (int i = 0; i < nfields; i++) {
+            RedisModuleString *value = RedisModule_CreateString(ctx, values[i], values[i + 1] - values[i] - 1);
+            ts_index_drop(ctx, name, fields[i], value, entity);
+            RedisModule_FreeString(ctx, value);
+        }
+        return;
+    }
+
+    // Otherwise try every value of each key field
+    for (int i = 0; i < nfields; i++) {
+        size_t count;
+        RedisModuleString **all = ts_index_values(ctx, name, fields[i], &count);
+        for (size_t j = 0; j < count; j++) {
+            ts_index_drop(ctx, name, fields[i], all[j], entity);
+            RedisModule_FreeString(ctx, all[j]);
+        }
+        RedisModule_Free(all);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef _TS_INDEX_H_
+#define _TS_INDEX_H_
+
+#include "timeseries.h"
+#include "ts_intern.h"
+
+/* Label index of a doc, kept in redis sets:
+ *   <name>.idx                   every entity (key prefix) of the doc
+ *   <name>.idx:<label>=<value>   the entities whose key field label has value
+ *   <name>.idx:<label>           the values of key field label
+ * */
+#define TS_INDEX_SUFFIX ".idx"
+
+/* A label=value or label!=value query term */
+typedef struct TSFilter {
+    RedisModuleString *set;  // Index set of the label value
+    int negate;
+    int meta;                // Matched against the series metadata, not the index
+    const char *label;
+    int label_len;
+    const char *value;
+    TSAtom label_id;         // Interned label and value of a meta filter
+    TSAtom value_id;
+} TSFilter;
+
+/* Add entity to the index of doc 'name', with its labels as "label=value" strings */
+void ts_index_add(RedisModuleCtx *ctx, const char *name, const char *entity, size_t entity_len,
+                  char **labels, int nlabels);
+
+/* Parse argc "label=value" or "label!=value" arguments into filters.
+ * Returns REDISMODULE_ERR if an argument isn't a filter. */
+int ts_index_filters(RedisModuleCtx *ctx, const char *name, RedisModuleString **argv, int argc, TSFilter *filters);
+
+/* Entities of doc 'name' matching every index filter, all of them if there are no filters.
+ * The array is allocated with RedisModule_Alloc, *count is set to its length. */
+RedisModuleString **ts_index_query(RedisModuleCtx *ctx, const char *name, TSFilter *filters, int nfilters,
+                                   size_t *count);
+
+/* Values of key field label. The array is allocated with RedisModule_Alloc, *count is set to its length. */
+RedisModuleString **ts_index_values(RedisModuleCtx *ctx, const char *name, const char *label, size_t *count);
+
+/* Drop an entity that no longer has series from every index set of doc 'name', and the values of its key fields
+ * that no other entity has. The entity is "<name>:<value>:<value>...", a value per key field in order. */
+void ts_index_remove(RedisModuleCtx *ctx, const char *name, RedisModuleString *entity,
+                     const char **fields, int nfields);
+
+#endif
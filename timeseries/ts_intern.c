@@ -0,0 +1,124 @@
+#include "ts_intern.h"
+#include <pthread.h>
+
+typedef struct TSInterned {
+    char *str;      // NULL for a free id
+    size_t len;
+    uint32_t hash;  // The next free id, for a free id
+    uint32_t refcount;
+} TSInterned;
+
+static TSInterned *atoms;       // Indexed by id, atoms[0] is unused
+static uint32_t natoms = 1;
+static TSAtom free_head;        // Ids released for reuse, linked through their hash
+static TSAtom *slots;           // Open addressing table of ids, TS_ATOM_NONE for an empty slot
+static uint32_t nslots, nused;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t ts_intern_hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;   // FNV-1a
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+/* Slot of s, or the empty slot where it belongs */
+static uint32_t ts_intern_slot(const char *s, size_t len, uint32_t hash) {
+    uint32_t i = hash & (nslots - 1);
+    for (; slots[i] != TS_ATOM_NONE; i = (i + 1) & (nslots - 1)) {
+        TSInterned *a = &atoms[slots[i]];
+        if (a->hash == hash && a->len == len && !memcmp(a->str, s, len))
+            break;
+    }
+    return i;
+}
+
+static void ts_intern_rehash(uint32_t size) {
+    RedisModule_Free(slots);
+    slots = RedisModule_Calloc(size, sizeof(TSAtom));
+    nslots = size;
+    for (uint32_t id = 1; id < natoms; id++)
+        if (atoms[id].str)
+            slots[ts_intern_slot(atoms[id].str, atoms[id].len, atoms[id].hash)] = id;
+}
+
+TSAtom ts_intern_find(const char *s, size_t len) {
+    uint32_t hash = ts_intern_hash(s, len);
+    TSAtom id = TS_ATOM_NONE;
+
+    pthread_mutex_lock(&lock);
+    if (nslots)
+        id = slots[ts_intern_slot(s, len, hash)];
+    pthread_mutex_unlock(&lock);
+    return id;
+}
+
+TSAtom ts_intern(const char *s, size_t len) {
+    uint32_t hash = ts_intern_hash(s, len);
+
+    pthread_mutex_lock(&lock);
+    // Keep the table at most half full
+    if ((nused + 1) * 2 > nslots)
+        ts_intern_rehash(nslots ? nslots * 2 : 64);
+
+    uint32_t slot = ts_intern_slot(s, len, hash);
+    if (slots[slot] != TS_ATOM_NONE) {
+        TSAtom id = slots[slot];
+        atoms[id].refcount++;
+        pthread_mutex_unlock(&lock);
+        return id;
+    }
+
+    TSAtom id;
+    if (free_head != TS_ATOM_NONE) {
+        id = free_head;
+        free_head = atoms[id].hash;
+    } else {
+        if (!(natoms & (natoms - 1)))
+            atoms = RedisModule_Realloc(atoms, sizeof(TSInterned) * natoms * 2);
+        id = natoms++;
+    }
+    atoms[id] = (TSInterned){ .str = RedisModule_Alloc(len + 1), .len = len, .hash = hash, .refcount = 1 };
+    memcpy(atoms[id].str, s, len);
+    atoms[id].str[len] = '\0';
+    slots[slot] = id;
+    nused++;
+    pthread_mutex_unlock(&lock);
+    return id;
+}
+
+const char *ts_intern_str(TSAtom id) {
+    return atoms[id].str;
+}
+
+/* Empty slot i, shifting back the following entries of its probe chain into the hole */
+static void ts_intern_unlink(uint32_t i) {
+    uint32_t mask = nslots - 1;
+
+    for (uint32_t j = (i + 1) & mask; slots[j] != TS_ATOM_NONE; j = (j + 1) & mask) {
+        // An entry whose home slot is cyclically in (i, j] can't move before it
+        uint32_t home = atoms[slots[j]].hash & mask;
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            continue;
+        slots[i] = slots[j];
+        i = j;
+    }
+    slots[i] = TS_ATOM_NONE;
+}
+
+void ts_intern_release(TSAtom id) {
+    if (id == TS_ATOM_NONE)
+        return;
+
+    pthread_mutex_lock(&lock);
+    TSInterned *a = &atoms[id];
+    if (!--a->refcount) {
+        ts_intern_unlink(ts_intern_slot(a->str, a->len, a->hash));
+        RedisModule_Free(a->str);
+        a->str = NULL;
+        a->hash = free_head;
+        free_head = id;
+        nused--;
+    }
+    pthread_mutex_unlock(&lock);
+}
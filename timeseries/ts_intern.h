@@ -0,0 +1,29 @@
+#ifndef _TS_INTERN_H_
+#define _TS_INTERN_H_
+
+#include <stdint.h>
+
+#include "timeseries.h"
+
+/* Module wide table of the label and column names and values that series refer to by id.
+ * Equal strings share one reference counted copy and compare as equal ids.
+ * Ids are taken and strings read on the main thread, but series are also freed on the lazyfree thread, so the
+ * table is changed and searched under a lock. */
+typedef uint32_t TSAtom;
+
+// Never the id of a string
+#define TS_ATOM_NONE 0
+
+/* Id of s, adding it if needed. Takes a reference that ts_intern_release returns. */
+TSAtom ts_intern(const char *s, size_t len);
+
+/* Id of s without taking a reference, or TS_ATOM_NONE if no series refers to it */
+TSAtom ts_intern_find(const char *s, size_t len);
+
+/* The string of an id, valid as long as a reference is held. Main thread only, without the lock, so a save in a
+ * forked child can't wait on a lock held by another thread at the fork. */
+const char *ts_intern_str(TSAtom id);
+
+void ts_intern_release(TSAtom id);
+
+#endif
@@ -0,0 +1,77 @@
+#include <limits.h>
+
+#include "ts_options.h"
+#include "ts_pool.h"
+
+TSOptions ts_options = {
+    .threads = 0,
+    .async_get = 100000,
+    .write_behind = 0,
+    .cold_dir = NULL,
+    .file_dir = NULL,
+    .cold_age = 30 * 86400,
+    .max_future = 0,
+    .late_window = 0,
+    .outlier_policy = ts_outlier_reject,
+};
+
+static int ts_option_range(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, int i,
+        long long *value, long long min, long long max) {
+    if (RMUtil_ParseArgs(argv, argc, i + 1, "l", value) != REDISMODULE_OK || *value < min || *value > max) {
+        RedisModule_Log(ctx, "warning", "%s must be an integer between %lld and %lld",
+            RedisModule_StringPtrLen(argv[i], NULL), min, max);
+        return REDISMODULE_ERR;
+    }
+    return REDISMODULE_OK;
+}
+
+int ts_options_load(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    for (int i = 0; i < argc; i += 2) {
+        const char *opt = RedisModule_StringPtrLen(argv[i], NULL);
+
+        if (i + 1 == argc) {
+            RedisModule_Log(ctx, "warning", "Missing value for module option %s", opt);
+            return REDISMODULE_ERR;
+        }
+
+        if (!strcasecmp(opt, "THREADS")) {
+            if (ts_option_range(ctx, argv, argc, i, &ts_options.threads, 0, TS_MAX_THREADS) != REDISMODULE_OK)
+                return REDISMODULE_ERR;
+        } else if (!strcasecmp(opt, "ASYNC_GET")) {
+            if (ts_option_range(ctx, argv, argc, i, &ts_options.async_get, 0, LLONG_MAX) != REDISMODULE_OK)
+                return REDISMODULE_ERR;
+        } else if (!strcasecmp(opt, "WRITE_BEHIND")) {
+            if (ts_option_range(ctx, argv, argc, i, &ts_options.write_behind, 0, TS_MAX_WRITE_BEHIND) != REDISMODULE_OK)
+                return REDISMODULE_ERR;
+        } else if (!strcasecmp(opt, "COLD_DIR")) {
+            ts_options.cold_dir = RedisModule_Strdup(RedisModule_StringPtrLen(argv[i + 1], NULL));
+        } else if (!strcasecmp(opt, "FILE_DIR")) {
+            ts_options.file_dir = RedisModule_Strdup(RedisModule_StringPtrLen(argv[i + 1], NULL));
+        } else if (!strcasecmp(opt, "COLD_AGE")) {
+            if (ts_option_range(ctx, argv, argc, i, &ts_options.cold_age, 0, LLONG_MAX) != REDISMODULE_OK)
+                return REDISMODULE_ERR;
+        } else if (!strcasecmp(opt, "MAX_FUTURE")) {
+            if (ts_option_range(ctx, argv, argc, i, &ts_options.max_future, 0, INT_MAX) != REDISMODULE_OK)
+                return REDISMODULE_ERR;
+        } else if (!strcasecmp(opt, "LATE_WINDOW")) {
+            if (ts_option_range(ctx, argv, argc, i, &ts_options.late_window, 0, INT_MAX) != REDISMODULE_OK)
+                return REDISMODULE_ERR;
+        } else if (!strcasecmp(opt, "OUTLIER_POLICY")) {
+            const char *policy = RedisModule_StringPtrLen(argv[i + 1], NULL);
+            if (!strcasecmp(policy, "reject")) {
+                ts_options.outlier_policy = ts_outlier_reject;
+            } else if (!strcasecmp(policy, "drop")) {
+                ts_options.outlier_policy = ts_outlier_drop;
+            } else if (!strcasecmp(policy, "clamp")) {
+                ts_options.outlier_policy = ts_outlier_clamp;
+            } else {
+                RedisModule_Log(ctx, "warning", "OUTLIER_POLICY must be one of reject, drop, clamp");
+                return REDISMODULE_ERR;
+            }
+        } else {
+            RedisModule_Log(ctx, "warning", "Unknown module option %s", opt);
+            return REDISMODULE_ERR;
+        }
+    }
+    return REDISMODULE_OK;
+}
@@ -0,0 +1,35 @@
+#ifndef _TS_OPTIONS_H_
+#define _TS_OPTIONS_H_
+
+#include "timeseries.h"
+
+// Upper bound for the write behind staging buffer of a series
+#define TS_MAX_WRITE_BEHIND 4096
+
+/* What happens to a value with a timestamp past MAX_FUTURE or before LATE_WINDOW */
+typedef enum {
+    ts_outlier_reject,  // Reply with an error
+    ts_outlier_drop,    // Reply OK without adding the value
+    ts_outlier_clamp    // Add the value to the nearest bucket in the window
+} TSOutlierPolicy;
+
+/* Module options, given as name/value pairs after the module path:
+ *   --loadmodule timeseries.so THREADS 4 ASYNC_GET 100000
+ * */
+typedef struct TSOptions {
+    long long threads;      // Worker threads parsing TS.INSERTDOC documents. 0 parses on the main thread
+    long long async_get;    // TS.GET ranges of at least this many buckets are replied from a worker. 0 never
+    long long write_behind; // Inserts staged per series before they are folded into the buckets. 0 disables staging
+    const char *cold_dir;   // Directory of the cold tier file. NULL keeps every chunk in memory
+    const char *file_dir;   // Directory of the files TS.EXPORT writes and TS.IMPORT reads. NULL refuses every path
+    long long cold_age;     // Seconds after which a sealed chunk moves to the cold tier
+    long long max_future;   // Seconds past now a timestamp can be. 0 for no limit
+    long long late_window;  // Seconds before now a timestamp can be. 0 for no limit other than the series start
+    TSOutlierPolicy outlier_policy;
+} TSOptions;
+
+extern TSOptions ts_options;
+
+int ts_options_load(RedisModuleCtx *ctx, RedisModuleString **argv, int argc);
+
+#endif
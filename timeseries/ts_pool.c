@@ -0,0 +1,67 @@
+#include <pthread.h>
+
+#include "ts_pool.h"
+
+typedef struct TSJob {
+    TSJobFunc fn;
+    void *arg;
+    struct TSJob *next;
+} TSJob;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static TSJob *head, *tail;
+static int size;
+
+static void *ts_pool_worker(void *unused) {
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        while (!head)
+            pthread_cond_wait(&cond, &lock);
+        TSJob *job = head;
+        if (!(head = job->next))
+            tail = NULL;
+        pthread_mutex_unlock(&lock);
+
+        job->fn(job->arg);
+        RedisModule_Free(job);
+    }
+    return NULL;
+}
+
+int ts_pool_start(int nthreads) {
+    pthread_attr_t attr;
+    pthread_t tid;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (; nthreads > 0; nthreads--) {
+        if (pthread_create(&tid, &attr, ts_pool_worker, NULL)) {
+            pthread_attr_destroy(&attr);
+            return REDISMODULE_ERR;
+        }
+        size++;
+    }
+    pthread_attr_destroy(&attr);
+    return REDISMODULE_OK;
+}
+
+int ts_pool_size(void) {
+    return size;
+}
+
+void ts_pool_submit(TSJobFunc fn, void *arg) {
+    TSJob *job = RedisModule_Alloc(sizeof(*job));
+    job->fn = fn;
+    job->arg = arg;
+    job->next = NULL;
+
+    pthread_mutex_lock(&lock);
+    if (tail)
+        tail->next = job;
+    else
+        head = job;
+    tail = job;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&lock);
+}
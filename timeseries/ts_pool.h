@@ -0,0 +1,20 @@
+#ifndef _TS_POOL_H_
+#define _TS_POOL_H_
+
+#include "timeseries.h"
+
+// Upper bound for the number of worker threads
+#define TS_MAX_THREADS 64
+
+typedef void (*TSJobFunc)(void *arg);
+
+/* Start nthreads detached workers. Returns REDISMODULE_ERR if a thread can't be started. */
+int ts_pool_start(int nthreads);
+
+/* Number of running workers. 0 means jobs must run on the main thread. */
+int ts_pool_size(void);
+
+/* Queue fn(arg) to run on one of the workers */
+void ts_pool_submit(TSJobFunc fn, void *arg);
+
+#endif
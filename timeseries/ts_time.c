@@ -0,0 +1,189 @@
+#include "ts_time.h"
+#include <ctype.h>
+#include <pthread.h>
+
+enum {
+    ts_time_literal,    // One literal character
+    ts_time_space,      // Any run of white space, as a space in a strptime format
+    ts_time_year,       // %Y, 4 digits
+    ts_time_year2,      // %y, 2 digits: 69-99 are 19xx, 00-68 20xx
+    ts_time_month,      // %m and the rest, 2 digits
+    ts_time_mday,
+    ts_time_hour,
+    ts_time_min,
+    ts_time_sec,
+};
+
+void ts_timefmt_compile(TSTimeFmt *f, const char *format) {
+    f->format = format;
+    f->nops = 0;
+
+    for (const char *p = format; *p; p++) {
+        TSTimeOp op = { ts_time_literal, *p };
+        if (f->nops == TS_TIMEFMT_OPS)
+            goto strptime_only;
+
+        if (isspace((unsigned char)*p)) {
+            op.kind = ts_time_space;
+            while (isspace((unsigned char)p[1]))
+                p++;
+        } else if (*p == '%') {
+            switch (*++p) {
+            case 'Y': op.kind = ts_time_year; break;
+            case 'y': op.kind = ts_time_year2; break;
+            case 'm': op.kind = ts_time_month; break;
+            case 'd': op.kind = ts_time_mday; break;
+            case 'H': op.kind = ts_time_hour; break;
+            case 'M': op.kind = ts_time_min; break;
+            case 'S': op.kind = ts_time_sec; break;
+            case '%': op.c = '%'; break;
+            default: goto strptime_only;
+            }
+        }
+        f->ops[f->nops++] = op;
+    }
+    return;
+
+strptime_only:
+    f->nops = 0;
+}
+
+static TSTimeFmt default_timefmt;
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+
+static void ts_timefmt_default_init(void) {
+    ts_timefmt_compile(&default_timefmt, DEFAULT_TIMEFMT);
+}
+
+const TSTimeFmt *ts_timefmt_default(void) {
+    pthread_once(&default_once, ts_timefmt_default_init);
+    return &default_timefmt;
+}
+
+const TSTimeFmt *ts_timefmt_new(const char *format) {
+    if (!strcmp(format, DEFAULT_TIMEFMT))
+        return ts_timefmt_default();
+
+    size_t len = strlen(format) + 1;
+    TSTimeFmt *f = RedisModule_Alloc(sizeof(*f) + len);
+    memcpy(f + 1, format, len);
+    ts_timefmt_compile(f, (const char *)(f + 1));
+    return f;
+}
+
+void ts_timefmt_free(const TSTimeFmt *f) {
+    if (f && f != &default_timefmt)
+        RedisModule_Free((void *)f);
+}
+
+/* Read exactly width digits at *p into *v, within [min, max] */
+static int ts_time_number(const char **p, int width, int min, int max, int *v) {
+    *v = 0;
+    for (int i = 0; i < width; i++) {
+        unsigned d = (unsigned char)(*p)[i] - '0';
+        if (d > 9)
+            return 0;
+        *v = *v * 10 + d;
+    }
+    *p += width;
+    return *v >= min && *v <= max;
+}
+
+/* Run the program of f on s. Returns the end of the timestamp, or NULL where s deviates from the fixed layout,
+ * strptime decides then. */
+static const char *ts_timefmt_run(const TSTimeFmt *f, const char *s, struct tm *st) {
+    const char *p = s;
+    int v;
+
+    for (int i = 0; i < f->nops; i++) {
+        const TSTimeOp *op = &f->ops[i];
+        switch (op->kind) {
+        case ts_time_literal:
+            if (*p++ != op->c)
+                return NULL;
+            break;
+        case ts_time_space:
+            while (isspace((unsigned char)*p))
+                p++;
+            break;
+        case ts_time_year:
+            if (!ts_time_number(&p, 4, 0, 9999, &v))
+                return NULL;
+            st->tm_year = v - 1900;
+            break;
+        case ts_time_year2:
+            if (!ts_time_number(&p, 2, 0, 99, &v))
+                return NULL;
+            st->tm_year = v >= 69 ? v : v + 100;
+            break;
+        case ts_time_month:
+            if (!ts_time_number(&p, 2, 1, 12, &v))
+                return NULL;
+            st->tm_mon = v - 1;
+            break;
+        case ts_time_mday:
+            if (!ts_time_number(&p, 2, 1, 31, &st->tm_mday))
+                return NULL;
+            break;
+        case ts_time_hour:
+            if (!ts_time_number(&p, 2, 0, 23, &st->tm_hour))
+                return NULL;
+            break;
+        case ts_time_min:
+            if (!ts_time_number(&p, 2, 0, 59, &st->tm_min))
+                return NULL;
+            break;
+        case ts_time_sec:
+            if (!ts_time_number(&p, 2, 0, 61, &st->tm_sec))
+                return NULL;
+            break;
+        }
+    }
+    return p;
+}
+
+int ts_timefmt_parse(const TSTimeFmt *f, const char *s, struct tm *st) {
+    struct tm parsed = *st;
+
+    if (f->nops && ts_timefmt_run(f, s, &parsed)) {
+        *st = parsed;
+        return 1;
+    }
+    return strptime(s, f->format, st) != NULL;
+}
+
+int ts_timefmt_exact(const TSTimeFmt *f, const char *s, struct tm *st) {
+    struct tm parsed = *st;
+    const char *end = f->nops ? ts_timefmt_run(f, s, &parsed) : NULL;
+
+    if (!end || *end)
+        return 0;
+    *st = parsed;
+    return 1;
+}
+
+int ts_timefmt_digits(const TSTimeFmt *f) {
+    int digits = 0;
+
+    for (int i = 0; i < f->nops; i++) {
+        if (f->ops[i].kind == ts_time_literal || f->ops[i].kind == ts_time_space)
+            return 0;
+        digits += f->ops[i].kind == ts_time_year ? 4 : 2;
+    }
+    return digits;
+}
+
+/* Days from 1970-01-01 to a proleptic Gregorian date. Day 0 of a month is the last day of the month before. */
+static int64_t days_from_civil(int64_t y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+time_t ts_timegm(const struct tm *st) {
+    int64_t y = 1900 + (int64_t)st->tm_year + st->tm_mon / 12;
+    int m = st->tm_mon % 12 + 1;
+    return days_from_civil(y, m, st->tm_mday) * 86400 + st->tm_hour * 3600 + st->tm_min * 60 + st->tm_sec;
+}
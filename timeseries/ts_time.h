@@ -0,0 +1,46 @@
+#ifndef _TS_TIME_H_
+#define _TS_TIME_H_
+
+#include "timeseries.h"
+
+// Most fields and literals in a compiled time format
+#define TS_TIMEFMT_OPS 32
+
+typedef struct TSTimeOp {
+    unsigned char kind;
+    char c;             // Character of a literal
+} TSTimeOp;
+
+/* A strptime format compiled once into the fixed width numbers and literals it reads */
+typedef struct TSTimeFmt {
+    const char *format;
+    int nops;           // 0 if the format has directives only strptime handles
+    TSTimeOp ops[TS_TIMEFMT_OPS];
+} TSTimeFmt;
+
+/* Compile format into f, which refers to format */
+void ts_timefmt_compile(TSTimeFmt *f, const char *format);
+
+/* The compiled DEFAULT_TIMEFMT, shared by every series created without a time format */
+const TSTimeFmt *ts_timefmt_default(void);
+
+/* A compiled copy of format for a series, or the shared default for DEFAULT_TIMEFMT. Free with ts_timefmt_free. */
+const TSTimeFmt *ts_timefmt_new(const char *format);
+
+void ts_timefmt_free(const TSTimeFmt *f);
+
+/* strptime of s with the format of f into st. Timestamps laid out as the compiled program expects, with zero
+ * padded numbers, are read directly. Returns 0 if s isn't a timestamp of the format. */
+int ts_timefmt_parse(const TSTimeFmt *f, const char *s, struct tm *st);
+
+/* ts_timefmt_parse of all of s by the compiled program alone, without the lenient strptime */
+int ts_timefmt_exact(const TSTimeFmt *f, const char *s, struct tm *st);
+
+/* Length of the timestamps of f when they're all digits, like the 10 of "%Y%m%d%H", else 0. Also 0 for formats
+ * left to strptime, which aren't inspected. */
+int ts_timefmt_digits(const TSTimeFmt *f);
+
+/* mktime for UTC, with civil date arithmetic instead of time zone lookups */
+time_t ts_timegm(const struct tm *st);
+
+#endif
@@ -1,28 +1,98 @@
 #include "ts_entry.h"
+#include "ts_utils.h"
 
-time_t interval2timestamp(Interval interval, const char *timestamp, const char *format) {
-    return interval_timestamp(interval2str(interval), timestamp, format);
+/* Truncate st to the start of its interval */
+static time_t interval_truncate(Interval interval, struct tm *st) {
+    if (interval == second) return ts_timegm(st);
+    st->tm_sec =  0; if (interval == minute) return ts_timegm(st);
+    st->tm_min =  0; if (interval == hour) return ts_timegm(st);
+    st->tm_hour = 0; if (interval == day)   return ts_timegm(st);
+    st->tm_mday = 0; if (interval == month)    return ts_timegm(st);
+    st->tm_mon =  0;
+    return ts_timegm(st);
 }
 
-time_t interval_timestamp(const char *interval, const char *timestamp, const char *format) {
+/* The bucket of the current time per interval, with the times [from, to) that fall in it.
+ * Per thread, as documents are prepared on the pool. */
+typedef struct TSNowBucket {
+    Interval interval;
+    time_t bucket;
+    time_t from;
+    time_t to;
+} TSNowBucket;
+
+static __thread TSNowBucket now_buckets[6];
+
+/* Start of the bucket of the current time. Refreshed only when the time leaves the cached bucket, so most calls
+ * are a time() and a compare. */
+static time_t interval_now(Interval interval) {
+    time_t t = time(NULL);
+    TSNowBucket *b = now_buckets;
+
+    while (b->interval && b->interval != interval && b < now_buckets + 5)
+        b++;
+    if (b->interval == interval && t >= b->from && t < b->to)
+        return b->bucket;
+
+    b->interval = interval;
+    b->bucket = interval_range(interval, t, &b->from, &b->to);
+    return b->bucket;
+}
+
+time_t interval2timestamp(Interval interval, const char *timestamp, const TSTimeFmt *format) {
     struct tm st;
+
+    if (!timestamp || !format)
+        return interval_now(interval);
+
     memset(&st, 0, sizeof(struct tm));
-    if (timestamp && format) {
-        if (!strptime(timestamp, format, &st))
-            return 0;
+    if (!ts_timefmt_parse(format, timestamp, &st))
+        return 0;
+    return interval_truncate(interval, &st);
+}
+
+time_t interval_timestamp(const char *interval, const char *timestamp, const char *format) {
+    TSTimeFmt compiled;
+
+    if (format)
+        ts_timefmt_compile(&compiled, format);
+    return interval2timestamp(str2interval(interval), timestamp, format ? &compiled : NULL);
+}
+
+time_t interval_epoch(Interval interval, time_t t) {
+    struct tm st;
+
+    if (interval == second)
+        return t;
+    gmtime_r(&t, &st);
+    return interval_truncate(interval, &st);
+}
+
+time_t interval_range(Interval interval, time_t t, time_t *from, time_t *to) {
+    struct tm st;
+
+    if (interval == second) {
+        *from = t;
+        *to = t + 1;
+        return t;
     }
-    else {
-        time_t t = time(NULL);
-        gmtime_r(&t, &st);
+    gmtime_r(&t, &st);
+    time_t bucket = interval_truncate(interval, &st);
+    if (interval != month && interval != year) {
+        *from = bucket;
+        *to = bucket + interval;
+        return bucket;
     }
 
-    if (!strcmp(interval, SECOND)) return mktime(&st);
-    st.tm_sec =  0; if (!strcmp(interval, MINUTE)) return mktime(&st);
-    st.tm_min =  0; if (!strcmp(interval, HOUR)) return mktime(&st);
-    st.tm_hour = 0; if (!strcmp(interval, DAY))   return mktime(&st);
-    st.tm_mday = 0; if (!strcmp(interval, MONTH))    return mktime(&st);
-    st.tm_mon =  0;
-    return mktime(&st);
+    // Month and year buckets are stamped with day 0, the last day of the month before, but hold the calendar month
+    st.tm_mday = 1;
+    *from = ts_timegm(&st);
+    if (interval == month)
+        st.tm_mon++;
+    else
+        st.tm_year++;
+    *to = ts_timegm(&st);
+    return bucket;
 }
 
 Interval str2interval(const char *interval) {
@@ -47,29 +117,101 @@ const char *interval2str(Interval interval) {
     return none;
 }
 
+Operation str2op(const char *op) {
+    if (!strcmp(SUM, op)) return op_sum;
+    if (!strcmp(AVG, op)) return op_avg;
+    if (!strcmp(COUNT, op)) return op_count;
+
+    return op_none;
+}
+
 size_t idx_timestamp(time_t init_timestamp, size_t cur_timestamp, Interval interval) {
     return difftime(cur_timestamp, init_timestamp) / interval;
 }
 
-char *doc_key_prefix(const char *name, cJSON *conf, cJSON *data)
-{
-	static char key_prefix[1000] = "";
-	strcpy(key_prefix, name);
-    strcat(key_prefix, ":");
-	cJSON *key_fields = cJSON_GetObjectItem(conf, "key_fields");
-	for (int i=0; i < cJSON_GetArraySize(key_fields); i++) {
-		cJSON *k = cJSON_GetArrayItem(key_fields, i);
-		cJSON *d = cJSON_GetObjectItem(data, k->valuestring);
-		strcat(key_prefix, d->valuestring);
-		strcat(key_prefix, ":");
-	}
-	return key_prefix;
-}
-
-char *doc_agg_key(char *key_prefix, cJSON *ts_field){
-	static char agg_key[1000];
-	sprintf(agg_key, "%s%s", key_prefix, ts_field->valuestring);
-	return agg_key;
+/* Build "<name>:<key field value>:..." into buf, computing the length once up front.
+ * Returns the prefix length, or 0 if it doesn't fit in size bytes. */
+size_t doc_key_prefix(char *buf, size_t size, const char *name, cJSON *conf, cJSON *data) {
+    cJSON *key_fields = cJSON_GetObjectItem(conf, "key_fields");
+    int n = cJSON_GetArraySize(key_fields);
+    const char *parts[n + 1];
+    size_t lens[n + 1], len = 0;
+
+    parts[0] = name;
+    for (int i = 0; i < n; i++)
+        parts[i + 1] = cJSON_GetObjectItem(data, cJSON_GetArrayItem(key_fields, i)->valuestring)->valuestring;
+    for (int i = 0; i <= n; i++)
+        len += (lens[i] = strlen(parts[i])) + (i ? 1 : 0);
+    if (len >= size)
+        return 0;
+
+    char *p = buf;
+    for (int i = 0; i <= n; i++) {
+        if (i)
+            *p++ = ':';
+        memcpy(p, parts[i], lens[i]);
+        p += lens[i];
+    }
+    *p = '\0';
+    return len;
+}
+
+/* "field=value" of every field listed in conf array 'fields', stored back to back in a single allocation
+ * that the first string points to. Returns NULL if the list is missing or empty. */
+char **doc_labels(cJSON *conf, const char *fields, cJSON *data, int *n) {
+    cJSON *list = cJSON_GetObjectItem(conf, fields);
+    size_t len = 0;
+
+    if (!(*n = list ? cJSON_GetArraySize(list) : 0))
+        return NULL;
+    for (int i = 0; i < *n; i++) {
+        const char *field = cJSON_GetArrayItem(list, i)->valuestring;
+        len += strlen(field) + strlen(cJSON_GetObjectString(data, field)) + 2;
+    }
+
+    char **labels = RedisModule_Alloc(*n * sizeof(char *));
+    char *label = RedisModule_Alloc(len);
+    for (int i = 0; i < *n; i++) {
+        const char *field = cJSON_GetArrayItem(list, i)->valuestring;
+        labels[i] = label;
+        label += sprintf(label, "%s=%s", field, cJSON_GetObjectString(data, field)) + 1;
+    }
+    return labels;
+}
+
+/* Does the doc conf store all its ts fields as columns of a single key? */
+int doc_group(cJSON *conf) {
+    cJSON *group = cJSON_GetObjectItem(conf, "group");
+    return group && (group->type & 0xFF) == cJSON_True;
+}
+
+const char *doc_timefmt(cJSON *conf) {
+    cJSON *timefmt = cJSON_GetObjectItem(conf, "timeformat");
+    return timefmt && (timefmt->type & 0xFF) == cJSON_String ? timefmt->valuestring : DEFAULT_TIMEFMT;
+}
+
+/* Append ":<ts_field>" to the prefix_len bytes of key prefix already in buf.
+ * Returns the aggregation key length, or 0 if it doesn't fit in size bytes. */
+size_t doc_agg_key(char *buf, size_t size, size_t prefix_len, cJSON *ts_field) {
+    size_t field_len = strlen(ts_field->valuestring);
+    if (prefix_len + 1 + field_len >= size)
+        return 0;
+
+    buf[prefix_len] = ':';
+    memcpy(&buf[prefix_len + 1], ts_field->valuestring, field_len + 1);
+    return prefix_len + 1 + field_len;
+}
+
+/* Parse a command argument as a double. Plain decimal numbers take the cJSON fast path;
+ * anything else it doesn't fully consume (inf, hex, leading '+') is left to redis. */
+int str2double(RedisModuleString *str, double *value) {
+    size_t len;
+    const char *s = RedisModule_StringPtrLen(str, &len);
+    const char *end = cJSON_ParseDouble(s, value);
+    if (end && end == s + len)
+        return REDISMODULE_OK;
+
+    return RedisModule_StringToDouble(str, value);
 }
 
 double agg_value(cJSON *data, cJSON *ts_field) {
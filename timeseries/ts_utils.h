@@ -3,20 +3,38 @@
 
 #include "timeseries.h"
 #include "ts_entry.h"
+#include "ts_time.h"
 
-time_t interval2timestamp(Interval interval, const char *timestamp, const char *format);
+time_t interval2timestamp(Interval interval, const char *timestamp, const TSTimeFmt *format);
 
 time_t interval_timestamp(const char *interval, const char *timestamp, const char *format);
 
+/* Truncate epoch seconds t to the start of its interval */
+time_t interval_epoch(Interval interval, time_t t);
+
+/* interval_epoch of t, with [*from, *to) set to the times that truncate to the same bucket */
+time_t interval_range(Interval interval, time_t t, time_t *from, time_t *to);
+
 Interval str2interval(const char *interval);
 
 const char *interval2str(Interval interval);
 
+Operation str2op(const char *op);
+
 size_t idx_timestamp(time_t init_timestamp, size_t cur_timestamp, Interval interval);
 
-char *doc_key_prefix(const char *name, cJSON *conf, cJSON *data);
+size_t doc_key_prefix(char *buf, size_t size, const char *name, cJSON *conf, cJSON *data);
+
+int doc_group(cJSON *conf);
+
+/* The time format of a doc configuration */
+const char *doc_timefmt(cJSON *conf);
+
+char **doc_labels(cJSON *conf, const char *fields, cJSON *data, int *n);
+
+size_t doc_agg_key(char *buf, size_t size, size_t prefix_len, cJSON *ts_field);
 
-char *doc_agg_key(char *key_prefix, cJSON *ts_field);
+int str2double(RedisModuleString *str, double *value);
 
 double agg_value(cJSON *data, cJSON *ts_field);
 